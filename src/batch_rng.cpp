@@ -0,0 +1,60 @@
+#include "batch_rng.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static uint64_t splitmix64(uint64_t &x) {
+	return mix64(x += 0x9e3779b97f4a7c15);
+}
+
+BatchRng::BatchRng(uint64_t seed) {
+	for (size_t i = 0; i < LANES; ++i) {
+		s0_[i] = splitmix64(seed);
+		s1_[i] = splitmix64(seed);
+	}
+}
+
+static void fill_scalar(uint64_t *s0, uint64_t *s1, uint64_t *out, size_t n) {
+	for (size_t i = 0; i < n; i += BatchRng::LANES) {
+		for (size_t j = 0; j < BatchRng::LANES; ++j) {
+			uint64_t x = s0[j];
+			uint64_t y = s1[j];
+			out[i + j] = x + y;
+			s0[j] = y;
+			x ^= x << 23;
+			s1[j] = x ^ y ^ (x >> 18) ^ (y >> 5);
+		}
+	}
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void fill_avx2(uint64_t *s0, uint64_t *s1, uint64_t *out, size_t n) {
+	static_assert(BatchRng::LANES == 4);
+	__m256i a = _mm256_load_si256((const __m256i *)s0);
+	__m256i b = _mm256_load_si256((const __m256i *)s1);
+	for (size_t i = 0; i < n; i += BatchRng::LANES) {
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_add_epi64(a, b));
+		__m256i x = _mm256_xor_si256(a, _mm256_slli_epi64(a, 23));
+		a = b;
+		b = _mm256_xor_si256(
+			_mm256_xor_si256(x, b),
+			_mm256_xor_si256(_mm256_srli_epi64(x, 18), _mm256_srli_epi64(b, 5))
+		);
+	}
+	_mm256_store_si256((__m256i *)s0, a);
+	_mm256_store_si256((__m256i *)s1, b);
+}
+#endif
+
+void BatchRng::fill(uint64_t *out, size_t n) {
+#if defined(__x86_64__)
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	if (has_avx2) {
+		fill_avx2(s0_, s1_, out, n);
+		return;
+	}
+#endif
+	fill_scalar(s0_, s1_, out, n);
+}
@@ -0,0 +1,36 @@
+#ifndef BATCH_RNG_H_
+#define BATCH_RNG_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// LANES interleaved xorshift128+ streams for drawing random numbers in
+// batches. The AVX2 path is selected at runtime and produces the same
+// sequence as the scalar one, so a seed gives the same offsets on every
+// machine.
+class BatchRng {
+public:
+	static constexpr size_t LANES = 4;
+
+	explicit BatchRng(uint64_t seed);
+	// n must be a multiple of LANES
+	void fill(uint64_t *out, size_t n);
+
+private:
+	alignas(32) uint64_t s0_[LANES];
+	alignas(32) uint64_t s1_[LANES];
+};
+
+// Scrambles the bits of z. It is the output function of splitmix64.
+inline uint64_t mix64(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+// Maps a uniformly random 64-bit number to [0, n)
+inline uint64_t bounded_rand(uint64_t r, uint64_t n) {
+	return (unsigned __int128)r * n >> 64;
+}
+
+#endif // BATCH_RNG_H_
@@ -0,0 +1,66 @@
+#include "clock.h"
+
+#include <chrono>
+#include <thread>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+TscClock tsc_clock = {
+	.enabled = false,
+	.base_tsc = 0,
+	.base_ns = 0,
+	.mult = 0,
+};
+
+#if defined(__x86_64__)
+static bool has_invariant_tsc() {
+	unsigned eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+	return edx & (1 << 8);
+}
+
+// Reads the TSC and CLOCK_MONOTONIC at about the same time. Of a few
+// tries, keeps the one with the fewest ticks around the clock read.
+static void sample(uint64_t &tsc, uint64_t &ns) {
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < 16; ++i) {
+		uint64_t before = read_tsc();
+		uint64_t now = monotonic_ns();
+		uint64_t after = read_tsc();
+		if (after - before < best) {
+			best = after - before;
+			tsc = before + (after - before) / 2;
+			ns = now;
+		}
+	}
+}
+#endif
+
+bool use_tsc_clock() {
+#if defined(__x86_64__)
+	if (!has_invariant_tsc()) {
+		return false;
+	}
+	uint64_t tsc0, ns0, tsc1, ns1;
+	sample(tsc0, ns0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	sample(tsc1, ns1);
+	if (tsc1 <= tsc0 || ns1 <= ns0) {
+		return false;
+	}
+	tsc_clock = TscClock{
+		.enabled = true,
+		.base_tsc = tsc1,
+		.base_ns = ns1,
+		.mult = (uint64_t)(((unsigned __int128)(ns1 - ns0) << 32) /
+			(tsc1 - tsc0)),
+	};
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,57 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <cstdint>
+#include <ctime>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// Derives nanoseconds from the TSC as base_ns + (tsc - base_tsc) * mult
+// / 2^32. Only set up by use_tsc_clock().
+struct TscClock {
+	bool enabled;
+	uint64_t base_tsc;
+	uint64_t base_ns;
+	uint64_t mult;
+};
+
+extern TscClock tsc_clock;
+
+inline uint64_t monotonic_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#if defined(__x86_64__)
+inline uint64_t read_tsc() {
+	// Unlike rdtsc, rdtscp waits for the instructions before it, so the
+	// timestamp is not taken ahead of the I/O it is for
+	unsigned aux;
+	return __rdtscp(&aux);
+}
+#endif
+
+// Monotonic time in nanoseconds. It is CLOCK_MONOTONIC unless
+// use_tsc_clock() has switched it to the TSC, which is cheaper to read
+// than even the vDSO clock_gettime.
+inline uint64_t clock_ns() {
+#if defined(__x86_64__)
+	if (tsc_clock.enabled) {
+		uint64_t ticks = read_tsc() - tsc_clock.base_tsc;
+		return tsc_clock.base_ns +
+			(uint64_t)((unsigned __int128)ticks * tsc_clock.mult >> 32);
+	}
+#endif
+	return monotonic_ns();
+}
+
+// Calibrates the TSC against CLOCK_MONOTONIC and makes clock_ns() read
+// it. Returns false and leaves clock_ns() alone if the CPU has no
+// invariant TSC, which would drift with frequency changes or differ
+// between cores. Call it before starting any thread that reads the clock.
+bool use_tsc_clock();
+
+#endif // CLOCK_H_
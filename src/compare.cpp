@@ -0,0 +1,318 @@
+#include "compare.h"
+
+#include <algorithm>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <rusty/macro.h>
+#include <string>
+#include <vector>
+
+#include "result.h"
+
+// Two-sided 95% critical values of Student's t by degrees of freedom,
+// from 1 to 30. Z_95 is close enough beyond.
+static const double T_95[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+enum class Significance {
+	Yes,
+	No,
+	// A single run per side gives no spread to test against
+	Unknown,
+};
+
+// The runs of the baseline or of the candidate
+struct Side {
+	std::vector<RunResult> runs;
+	// Latencies of all runs
+	Histogram latency;
+	uint64_t latency_sum_ns;
+};
+
+// paths is a comma-separated list of result files of repeated runs
+static Side load_side(const std::string &paths) {
+	Side side{
+		.runs = {},
+		.latency = Histogram(),
+		.latency_sum_ns = 0,
+	};
+	size_t begin = 0;
+	for (;;) {
+		size_t comma = paths.find(',', begin);
+		RunResult run = read_result(paths.substr(begin, comma - begin));
+		side.latency.merge(run.latency);
+		side.latency_sum_ns += run.latency_sum_ns;
+		side.runs.push_back(std::move(run));
+		if (comma == std::string::npos) {
+			return side;
+		}
+		begin = comma + 1;
+	}
+}
+
+static double mean(const std::vector<double> &v) {
+	double sum = 0;
+	for (double x : v) {
+		sum += x;
+	}
+	return sum / v.size();
+}
+
+static double sample_variance(const std::vector<double> &v) {
+	double m = mean(v);
+	double sum = 0;
+	for (double x : v) {
+		sum += (x - m) * (x - m);
+	}
+	return sum / (v.size() - 1);
+}
+
+// Welch's t-test on the values of the runs
+static Significance welch_test(
+	const std::vector<double> &a, const std::vector<double> &b
+) {
+	if (a.size() < 2 || b.size() < 2) {
+		return Significance::Unknown;
+	}
+	double va = sample_variance(a) / a.size();
+	double vb = sample_variance(b) / b.size();
+	double diff = std::abs(mean(a) - mean(b));
+	if (va + vb == 0) {
+		return diff > 0 ? Significance::Yes : Significance::No;
+	}
+	// Welch-Satterthwaite
+	double df = (va + vb) * (va + vb) /
+		(va * va / (a.size() - 1) + vb * vb / (b.size() - 1));
+	size_t n = std::max<size_t>(df, 1);
+	double critical = n <= std::size(T_95) ? T_95[n - 1] : Z_95;
+	return diff / std::sqrt(va + vb) > critical ?
+		Significance::Yes : Significance::No;
+}
+
+// Variance of the latencies, taking each bucket at its middle
+static double latency_variance(const Histogram &h, double mean) {
+	double sum = 0;
+	for (size_t i = 0; i < Histogram::NUM_BUCKETS; ++i) {
+		uint64_t n = h.bucket_count(i);
+		if (n) {
+			double mid = (
+				Histogram::bucket_lower(i) + Histogram::bucket_upper(i)
+			) / 2.0;
+			sum += n * (mid - mean) * (mid - mean);
+		}
+	}
+	return sum / (h.count() - 1);
+}
+
+// z-test of the mean latency over all I/Os
+static Significance mean_latency_test(const Side &a, const Side &b) {
+	uint64_t na = a.latency.count();
+	uint64_t nb = b.latency.count();
+	if (na < 2 || nb < 2) {
+		return Significance::Unknown;
+	}
+	double ma = (double)a.latency_sum_ns / na;
+	double mb = (double)b.latency_sum_ns / nb;
+	double se = std::sqrt(
+		latency_variance(a.latency, ma) / na +
+			latency_variance(b.latency, mb) / nb
+	);
+	if (se == 0) {
+		return ma != mb ? Significance::Yes : Significance::No;
+	}
+	return std::abs(ma - mb) / se > Z_95 ?
+		Significance::Yes : Significance::No;
+}
+
+// The percentiles differ significantly if their confidence intervals do
+// not overlap
+static Significance percentile_test(
+	const Histogram &a, const Histogram &b, double fraction
+) {
+	if (a.count() == 0 || b.count() == 0) {
+		return Significance::Unknown;
+	}
+	auto [a_low, a_high] = a.percentile_interval(fraction, Z_95);
+	auto [b_low, b_high] = b.percentile_interval(fraction, Z_95);
+	return a_high < b_low || b_high < a_low ?
+		Significance::Yes : Significance::No;
+}
+
+struct Metric {
+	const char *name;
+	double baseline;
+	double candidate;
+	bool higher_is_better;
+	Significance significance;
+};
+
+int run_compare(int argc, char **argv) {
+	std::string baseline_paths;
+	std::string candidate_paths;
+	double threshold_pct;
+
+	namespace po = boost::program_options;
+	po::options_description desc(
+		"Usage: compare [options] baseline candidate\n\n"
+			"baseline and candidate are result files written with "
+			"--json_output, or comma-separated lists of result files of "
+			"repeated runs. Differences are tested for significance at 95% "
+			"confidence: latency from the histograms, throughput and CPU "
+			"time per op from the spread of repeated runs. The exit status "
+			"is 1 if a metric is worse by more than the threshold and the "
+			"difference is significant or can not be tested.\n\n"
+			"Available options"
+	);
+	desc.add_options()("help", "Print help message");
+	desc.add_options()(
+		"baseline", po::value<std::string>(&baseline_paths)->required(),
+		"Result files of the baseline"
+	);
+	desc.add_options()(
+		"candidate", po::value<std::string>(&candidate_paths)->required(),
+		"Result files of the candidate"
+	);
+	desc.add_options()(
+		"threshold_pct", po::value<double>(&threshold_pct)->default_value(5),
+		"Largest change for the worse in percent that is not a regression"
+	);
+	po::positional_options_description positional;
+	positional.add("baseline", 1).add("candidate", 1);
+
+	po::variables_map vm;
+	po::store(
+		po::command_line_parser(argc, argv)
+			.options(desc)
+			.positional(positional)
+			.run(),
+		vm
+	);
+	if (vm.count("help")) {
+		std::cerr << desc << std::endl;
+		return 1;
+	}
+	po::notify(vm);
+	rusty_assert(threshold_pct >= 0, "threshold_pct must not be negative");
+
+	Side baseline = load_side(baseline_paths);
+	Side candidate = load_side(candidate_paths);
+	auto per_run = [](const Side &side, auto f) {
+		std::vector<double> values;
+		for (const RunResult &run : side.runs) {
+			values.push_back(f(run));
+		}
+		return values;
+	};
+	auto throughput = [](const RunResult &run) {
+		return run.bytes / run.run_time_s / 1e6;
+	};
+	auto cpu_per_op = [](const RunResult &run) {
+		return run.cpu_s / run.ops * 1e6;
+	};
+	std::vector<double> baseline_throughput = per_run(baseline, throughput);
+	std::vector<double> candidate_throughput =
+		per_run(candidate, throughput);
+	std::vector<double> baseline_cpu = per_run(baseline, cpu_per_op);
+	std::vector<double> candidate_cpu = per_run(candidate, cpu_per_op);
+
+	std::vector<Metric> metrics = {
+		{
+			.name = "throughput MB/s",
+			.baseline = mean(baseline_throughput),
+			.candidate = mean(candidate_throughput),
+			.higher_is_better = true,
+			.significance =
+				welch_test(baseline_throughput, candidate_throughput),
+		},
+		{
+			.name = "CPU us/op",
+			.baseline = mean(baseline_cpu),
+			.candidate = mean(candidate_cpu),
+			.higher_is_better = false,
+			.significance = welch_test(baseline_cpu, candidate_cpu),
+		},
+		{
+			.name = "latency mean ns",
+			.baseline =
+				(double)baseline.latency_sum_ns / baseline.latency.count(),
+			.candidate =
+				(double)candidate.latency_sum_ns / candidate.latency.count(),
+			.higher_is_better = false,
+			.significance = mean_latency_test(baseline, candidate),
+		},
+	};
+	const std::pair<const char *, double> percentiles[] = {
+		{"latency p50 ns", 0.5},
+		{"latency p90 ns", 0.9},
+		{"latency p99 ns", 0.99},
+		{"latency p99.9 ns", 0.999},
+	};
+	for (const auto &[name, fraction] : percentiles) {
+		metrics.push_back(Metric{
+			.name = name,
+			.baseline = (double)baseline.latency.percentile(fraction),
+			.candidate = (double)candidate.latency.percentile(fraction),
+			.higher_is_better = false,
+			.significance = percentile_test(
+				baseline.latency, candidate.latency, fraction
+			),
+		});
+	}
+
+	printf(
+		"Runs: baseline %zu, candidate %zu\n", baseline.runs.size(),
+		candidate.runs.size()
+	);
+	printf(
+		"%-18s %14s %14s %9s  %s\n", "metric", "baseline", "candidate",
+		"delta", "significant"
+	);
+	size_t regressions = 0;
+	for (const Metric &m : metrics) {
+		const char *significance = "";
+		switch (m.significance) {
+		case Significance::Yes:
+			significance = "yes";
+			break;
+		case Significance::No:
+			significance = "no";
+			break;
+		case Significance::Unknown:
+			significance = "n/a";
+			break;
+		}
+		if (m.baseline == 0) {
+			printf(
+				"%-18s %14.3f %14.3f %9s  %s\n", m.name, m.baseline,
+				m.candidate, "n/a", significance
+			);
+			continue;
+		}
+		double delta_pct = (m.candidate - m.baseline) / m.baseline * 100;
+		double worse_pct = m.higher_is_better ? -delta_pct : delta_pct;
+		bool regression = worse_pct > threshold_pct &&
+			m.significance != Significance::No;
+		regressions += regression;
+		printf(
+			"%-18s %14.3f %14.3f %+8.2f%%  %s%s\n", m.name, m.baseline,
+			m.candidate, delta_pct, significance,
+			regression ? "  REGRESSION" : ""
+		);
+	}
+	if (regressions) {
+		printf(
+			"%zu regressions over %g%%\n", regressions, threshold_pct
+		);
+		return 1;
+	}
+	printf("No regressions over %g%%\n", threshold_pct);
+	return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef COMPARE_H_
+#define COMPARE_H_
+
+// The compare subcommand. argv[0] is "compare". Compares result files of
+// a baseline and a candidate and returns 1 if the candidate regressed.
+int run_compare(int argc, char **argv);
+
+#endif // COMPARE_H_
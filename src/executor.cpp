@@ -0,0 +1,128 @@
+#include "executor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <rusty/macro.h>
+#include <thread>
+
+bool Task::promise_type::FinalAwaiter::await_suspend(
+	std::coroutine_handle<promise_type> h
+) noexcept {
+	h.promise().executor->live_ -= 1;
+	// Do not suspend, so that the frame is freed
+	return false;
+}
+
+Executor::Executor(
+	std::unique_ptr<IOEngine> engine, size_t depth, size_t complete_min,
+	size_t complete_max
+) : engine_(std::move(engine)),
+	complete_min_(complete_min),
+	complete_max_(complete_max),
+	start_ns_(clock_ns()),
+	completions_(complete_max),
+	live_(0),
+	queued_(0),
+	inflight_(0) {
+	for (size_t i = 0; i < depth; ++i) {
+		free_slots_.push_back(i);
+	}
+}
+
+// The low bits of the address of an awaiter hold the index of an I/O
+static_assert(alignof(Executor::IOAwaiter) >= Executor::MAX_CHAIN);
+static_assert(alignof(Executor::IOChainAwaiter) >= Executor::MAX_CHAIN);
+
+Executor::IOChainAwaiter::IOChainAwaiter(
+	Executor &ex, const IOUnit *ios, size_t n
+) : ex_(ex), n_(n) {
+	rusty_assert(
+		n_ > 0 && n_ <= MAX_CHAIN, "A chain has 1 to %zu I/Os", MAX_CHAIN
+	);
+	std::copy(ios, ios + n, ios_.begin());
+}
+
+void Executor::spawn(Task task) {
+	task.handle_.promise().executor = this;
+	ready_.push_back(task.handle_);
+	task.handle_ = nullptr;
+	live_ += 1;
+}
+
+void Executor::release_slot(size_t slot) {
+	if (slot_waiters_.empty()) {
+		free_slots_.push_back(slot);
+		return;
+	}
+	SlotAwaiter *waiter = slot_waiters_.front();
+	slot_waiters_.pop_front();
+	waiter->slot_ = slot;
+	ready_.push_back(waiter->handle_);
+}
+
+void Executor::run(rusty::time::Instant start) {
+	std::optional<rusty::time::Duration> wait =
+		start.checked_duration_since(rusty::time::Instant::now());
+	// start on clock_ns(), which may be another clock
+	if (wait.has_value()) {
+		start_ns_ = clock_ns() + wait.value().as_nanos();
+		std::this_thread::sleep_for(
+			std::chrono::nanoseconds(wait.value().as_nanos())
+		);
+	} else {
+		start_ns_ = clock_ns() - start.elapsed().as_nanos();
+	}
+	while (live_) {
+		while (!ready_.empty()) {
+			std::coroutine_handle<> h = ready_.front();
+			ready_.pop_front();
+			h.resume();
+		}
+		if (queued_) {
+			engine_->submit();
+			queued_ = 0;
+		}
+		if (live_ == 0) {
+			break;
+		}
+		uint64_t now = now_ns();
+		while (!timers_.empty() && timers_.top().deadline_ns <= now) {
+			ready_.push_back(timers_.top().handle);
+			timers_.pop();
+		}
+		if (!ready_.empty()) {
+			continue;
+		}
+		std::optional<rusty::time::Duration> timeout;
+		if (!timers_.empty()) {
+			timeout = rusty::time::Duration::from_nanos(
+				timers_.top().deadline_ns - now
+			);
+		}
+		if (inflight_ == 0) {
+			// Nothing to reap before the next tick
+			rusty_assert(timeout.has_value(), "All coroutines are blocked");
+			std::this_thread::sleep_for(
+				std::chrono::nanoseconds(timeout.value().as_nanos())
+			);
+			continue;
+		}
+		size_t min = std::min(std::max<size_t>(complete_min_, 1), inflight_);
+		size_t n = engine_->reap(completions_.data(), min, complete_max_, timeout);
+		uint64_t time = now_ns();
+		for (size_t i = 0; i < n; ++i) {
+			uint64_t user_data = completions_[i].user_data;
+			PendingIO *pending =
+				(PendingIO *)(user_data & ~(uint64_t)(MAX_CHAIN - 1));
+			pending->results_[user_data & (MAX_CHAIN - 1)] = IOResult{
+				.res = completions_[i].res,
+				.time_ns = time,
+			};
+			pending->pending_ -= 1;
+			if (pending->pending_ == 0) {
+				ready_.push_back(pending->handle_);
+			}
+		}
+		inflight_ -= n;
+	}
+}
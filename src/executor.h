@@ -0,0 +1,241 @@
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <rusty/time.h>
+#include <vector>
+
+#include "clock.h"
+#include "io_engine.h"
+
+class Executor;
+
+// A coroutine run by an Executor. It does not run until spawned, and its
+// frame is freed when it finishes.
+class Task {
+public:
+	struct promise_type {
+		Executor *executor = nullptr;
+
+		Task get_return_object() {
+			return Task(
+				std::coroutine_handle<promise_type>::from_promise(*this)
+			);
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		struct FinalAwaiter {
+			bool await_ready() noexcept { return false; }
+			bool await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+			void await_resume() noexcept {}
+		};
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	Task(Task &&other) : handle_(other.handle_) { other.handle_ = nullptr; }
+	Task(const Task &) = delete;
+	~Task() {
+		if (handle_) {
+			handle_.destroy();
+		}
+	}
+
+private:
+	explicit Task(std::coroutine_handle<promise_type> handle)
+	  : handle_(handle) {}
+
+	std::coroutine_handle<promise_type> handle_;
+
+	friend class Executor;
+};
+
+struct IOResult {
+	// Number of bytes transferred, or -errno
+	ssize_t res;
+	// Completion time, in nanoseconds since the start of Executor::run()
+	uint64_t time_ns;
+};
+
+// Runs coroutines on the calling thread. They wait for pacing ticks,
+// I/O slots and I/O completions. I/Os queued by the coroutines that are
+// ready to run are submitted together once they have all suspended.
+class Executor {
+public:
+	class SleepAwaiter {
+	public:
+		bool await_ready() const { return deadline_ns_ <= ex_.now_ns(); }
+		void await_suspend(std::coroutine_handle<> h) {
+			ex_.timers_.push(Timer{.deadline_ns = deadline_ns_, .handle = h});
+		}
+		void await_resume() const {}
+
+	private:
+		SleepAwaiter(Executor &ex, uint64_t deadline_ns)
+		  : ex_(ex), deadline_ns_(deadline_ns) {}
+
+		Executor &ex_;
+		uint64_t deadline_ns_;
+
+		friend class Executor;
+	};
+	class SlotAwaiter {
+	public:
+		bool await_ready() {
+			if (ex_.free_slots_.empty()) {
+				return false;
+			}
+			slot_ = ex_.free_slots_.back();
+			ex_.free_slots_.pop_back();
+			return true;
+		}
+		void await_suspend(std::coroutine_handle<> h) {
+			handle_ = h;
+			ex_.slot_waiters_.push_back(this);
+		}
+		size_t await_resume() const { return slot_; }
+
+	private:
+		SlotAwaiter(Executor &ex) : ex_(ex) {}
+
+		Executor &ex_;
+		size_t slot_;
+		std::coroutine_handle<> handle_;
+
+		friend class Executor;
+	};
+	// Maximum number of I/Os of a chain
+	static constexpr size_t MAX_CHAIN = 4;
+
+	// Waits for the I/Os of an awaiter. The user_data of each I/O is the
+	// address of the awaiter, with the index of the I/O in the low bits.
+	class PendingIO {
+	protected:
+		std::coroutine_handle<> handle_;
+		size_t pending_;
+		std::optional<IOResult> *results_;
+
+		friend class Executor;
+	};
+	class IOAwaiter : public PendingIO {
+	public:
+		bool await_ready() const { return false; }
+		void await_suspend(std::coroutine_handle<> h) {
+			handle_ = h;
+			pending_ = 1;
+			results_ = &result_;
+			io_.user_data = (uintptr_t)this;
+			ex_.engine_->queue(io_);
+			ex_.queued_ += 1;
+			ex_.inflight_ += 1;
+		}
+		IOResult await_resume() const { return result_.value(); }
+
+	private:
+		IOAwaiter(Executor &ex, const IOUnit &io) : ex_(ex), io_(io) {}
+
+		Executor &ex_;
+		IOUnit io_;
+		std::optional<IOResult> result_;
+
+		friend class Executor;
+	};
+	// Each I/O of the chain starts once the previous one has succeeded. If
+	// one fails, the rest fail with ECANCELED.
+	class IOChainAwaiter : public PendingIO {
+	public:
+		bool await_ready() const { return false; }
+		void await_suspend(std::coroutine_handle<> h) {
+			handle_ = h;
+			pending_ = n_;
+			results_ = chain_results_.data();
+			for (size_t i = 0; i < n_; ++i) {
+				IOUnit io = ios_[i];
+				io.user_data = (uintptr_t)this | i;
+				io.link = i + 1 < n_;
+				ex_.engine_->queue(io);
+			}
+			ex_.queued_ += n_;
+			ex_.inflight_ += n_;
+		}
+		// Results of the I/Os in the order of the chain
+		std::vector<IOResult> await_resume() const {
+			std::vector<IOResult> results;
+			for (size_t i = 0; i < n_; ++i) {
+				results.push_back(chain_results_[i].value());
+			}
+			return results;
+		}
+
+	private:
+		IOChainAwaiter(Executor &ex, const IOUnit *ios, size_t n);
+
+		Executor &ex_;
+		std::array<IOUnit, MAX_CHAIN> ios_;
+		size_t n_;
+		std::array<std::optional<IOResult>, MAX_CHAIN> chain_results_;
+
+		friend class Executor;
+	};
+
+	// Slots are handed out to at most depth I/Os in flight
+	Executor(
+		std::unique_ptr<IOEngine> engine, size_t depth, size_t complete_min,
+		size_t complete_max
+	);
+	void spawn(Task task);
+	// See IOEngine::register_file_slots
+	void register_file_slots(size_t n) { engine_->register_file_slots(n); }
+	// Waits until start, which may be in the future, and then runs until
+	// all spawned coroutines have finished
+	void run(rusty::time::Instant start);
+	// Nanoseconds since the start of run(), on clock_ns()
+	uint64_t now_ns() const { return clock_ns() - start_ns_; }
+	SleepAwaiter sleep_until(uint64_t deadline_ns) {
+		return SleepAwaiter(*this, deadline_ns);
+	}
+	SlotAwaiter acquire_slot() { return SlotAwaiter(*this); }
+	void release_slot(size_t slot);
+	IOAwaiter io(const IOUnit &io) { return IOAwaiter(*this, io); }
+	// Every I/O of the chain counts against the depth of the engine
+	IOChainAwaiter io_chain(const IOUnit *ios, size_t n) {
+		return IOChainAwaiter(*this, ios, n);
+	}
+
+private:
+	struct Timer {
+		uint64_t deadline_ns;
+		std::coroutine_handle<> handle;
+		bool operator>(const Timer &other) const {
+			return deadline_ns > other.deadline_ns;
+		}
+	};
+
+	std::unique_ptr<IOEngine> engine_;
+	size_t complete_min_;
+	size_t complete_max_;
+	// clock_ns() at the start of run()
+	uint64_t start_ns_;
+	std::deque<std::coroutine_handle<>> ready_;
+	std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>>
+		timers_;
+	std::vector<size_t> free_slots_;
+	std::deque<SlotAwaiter *> slot_waiters_;
+	std::vector<IOCompletion> completions_;
+	// Coroutines spawned and not finished yet
+	size_t live_;
+	// Queued but not submitted yet
+	size_t queued_;
+	size_t inflight_;
+
+	friend class Task;
+};
+
+#endif // EXECUTOR_H_
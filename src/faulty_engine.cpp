@@ -0,0 +1,174 @@
+#include "faulty_engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <queue>
+#include <random>
+#include <rusty/macro.h>
+#include <rusty/time.h>
+#include <thread>
+#include <vector>
+
+class FaultyEngine : public IOEngine {
+public:
+	FaultyEngine(
+		std::unique_ptr<IOEngine> inner, size_t depth, const FaultConfig &config,
+		uint64_t seed
+	) : inner_(std::move(inner)),
+		config_(config),
+		rng_(seed),
+		start_(rusty::time::Instant::now()),
+		inner_completions_(depth),
+		inner_inflight_(0),
+		cancel_next_(false),
+		inner_linked_(false) {}
+	void queue(const IOUnit &io) override {
+		if (cancel_next_) {
+			// Linked to an I/O that failed
+			hold(IOCompletion{.user_data = io.user_data, .res = -ECANCELED});
+			cancel_next_ = io.link;
+			return;
+		}
+		// Once part of a chain went to the device, the rest has to follow
+		// it there
+		if (
+			!inner_linked_ && config_.error_rate > 0 &&
+			std::uniform_real_distribution<double>()(rng_) < config_.error_rate
+		) {
+			// Fails without reaching the device
+			hold(IOCompletion{
+				.user_data = io.user_data,
+				.res = -config_.error_errno,
+			});
+			cancel_next_ = io.link;
+			return;
+		}
+		inner_->queue(io);
+		inner_inflight_ += 1;
+		inner_linked_ = io.link;
+	}
+	void submit() override { inner_->submit(); }
+	void register_file_slots(size_t n) override {
+		inner_->register_file_slots(n);
+	}
+	size_t reap(
+		IOCompletion *out, size_t min, size_t max,
+		std::optional<rusty::time::Duration> timeout
+	) override {
+		std::optional<uint64_t> deadline_ns;
+		if (timeout.has_value()) {
+			deadline_ns = now_ns() + timeout.value().as_nanos();
+		}
+		size_t n = 0;
+		for (;;) {
+			collect(0, rusty::time::Duration::from_nanos(0));
+			uint64_t now = now_ns();
+			while (n < max && !held_.empty() && held_.top().release_ns <= now) {
+				out[n++] = held_.top().completion;
+				held_.pop();
+			}
+			if (n >= min || (deadline_ns.has_value() && now >= deadline_ns)) {
+				return n;
+			}
+			// Wait for the next held completion to be due, a completion of
+			// the device, or the deadline, whichever comes first
+			std::optional<uint64_t> wake_ns = deadline_ns;
+			if (!held_.empty()) {
+				wake_ns = std::min(
+					wake_ns.value_or(UINT64_MAX), held_.top().release_ns
+				);
+			}
+			if (inner_inflight_) {
+				std::optional<rusty::time::Duration> wait;
+				if (wake_ns.has_value()) {
+					wait = rusty::time::Duration::from_nanos(
+						wake_ns.value() - now
+					);
+				}
+				collect(1, wait);
+			} else {
+				rusty_assert(wake_ns.has_value(), "Nothing to reap");
+				std::this_thread::sleep_for(
+					std::chrono::nanoseconds(wake_ns.value() - now)
+				);
+			}
+		}
+	}
+
+private:
+	struct Held {
+		uint64_t release_ns;
+		IOCompletion completion;
+		bool operator>(const Held &other) const {
+			return release_ns > other.release_ns;
+		}
+	};
+
+	uint64_t now_ns() const { return start_.elapsed().as_nanos(); }
+	// Moves completions of the device into held_
+	void collect(size_t min, std::optional<rusty::time::Duration> timeout) {
+		size_t got = inner_->reap(
+			inner_completions_.data(), min, inner_completions_.size(), timeout
+		);
+		inner_inflight_ -= got;
+		for (size_t i = 0; i < got; ++i) {
+			hold(inner_completions_[i]);
+		}
+	}
+	void hold(const IOCompletion &completion) {
+		uint64_t release = now_ns() + extra_latency_ns();
+		if (config_.stall_period_ns) {
+			uint64_t phase = release % config_.stall_period_ns;
+			if (phase < config_.stall_ns) {
+				release += config_.stall_ns - phase;
+			}
+		}
+		held_.push(Held{.release_ns = release, .completion = completion});
+	}
+	uint64_t extra_latency_ns() {
+		const LatencyDistribution &d = config_.latency;
+		double ns = 0;
+		switch (d.type) {
+		case LatencyDistributionType::None:
+			break;
+		case LatencyDistributionType::Fixed:
+			ns = d.a;
+			break;
+		case LatencyDistributionType::Uniform:
+			ns = std::uniform_real_distribution<double>(d.a, d.b)(rng_);
+			break;
+		case LatencyDistributionType::Exponential:
+			ns = std::exponential_distribution<double>(1 / d.a)(rng_);
+			break;
+		case LatencyDistributionType::LogNormal:
+			ns = std::lognormal_distribution<double>(std::log(d.a), d.b)(rng_);
+			break;
+		}
+		return ns;
+	}
+
+	std::unique_ptr<IOEngine> inner_;
+	FaultConfig config_;
+	std::mt19937_64 rng_;
+	rusty::time::Instant start_;
+	std::vector<IOCompletion> inner_completions_;
+	// Queued to the device and not reaped from it yet
+	size_t inner_inflight_;
+	// The next I/O is linked to one that was failed here
+	bool cancel_next_;
+	// The last I/O queued to the device is linked to the next one
+	bool inner_linked_;
+	// Completions waiting for their injected latency
+	std::priority_queue<Held, std::vector<Held>, std::greater<Held>> held_;
+};
+
+std::unique_ptr<IOEngine> new_faulty_engine(
+	std::unique_ptr<IOEngine> inner, size_t depth, const FaultConfig &config,
+	uint64_t seed
+) {
+	return std::make_unique<FaultyEngine>(
+		std::move(inner), depth, config, seed
+	);
+}
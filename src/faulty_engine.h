@@ -0,0 +1,49 @@
+#ifndef FAULTY_ENGINE_H_
+#define FAULTY_ENGINE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "io_engine.h"
+
+enum class LatencyDistributionType {
+	None,
+	// a
+	Fixed,
+	// Uniform in [a, b]
+	Uniform,
+	// Exponential with mean a
+	Exponential,
+	// Log-normal with median a and shape sigma b
+	LogNormal,
+};
+
+// Extra latency in nanoseconds
+struct LatencyDistribution {
+	LatencyDistributionType type;
+	double a;
+	double b;
+};
+
+struct FaultConfig {
+	LatencyDistribution latency;
+	// Fraction of I/Os that fail with error_errno instead of being done
+	double error_rate;
+	int error_errno;
+	// If stall_period_ns is not 0, the device completes nothing during the
+	// first stall_ns of every stall_period_ns
+	uint64_t stall_period_ns;
+	uint64_t stall_ns;
+};
+
+// Wraps a real engine and makes it look like a misbehaving device: I/Os
+// complete with extra latency, some fail, and completions stall at times.
+// It needs no root or device-mapper, so the effect of a bad device on
+// pacing and latency reporting can be tested anywhere.
+std::unique_ptr<IOEngine> new_faulty_engine(
+	std::unique_ptr<IOEngine> inner, size_t depth, const FaultConfig &config,
+	uint64_t seed
+);
+
+#endif // FAULTY_ENGINE_H_
@@ -0,0 +1,47 @@
+#include "file_tree.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <rusty/macro.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void make_dir(const std::string &path) {
+	if (mkdir(path.c_str(), S_IRWXU) == -1 && errno != EEXIST) {
+		perror("mkdir");
+		rusty_panic("Failed to create %s", path.c_str());
+	}
+}
+
+FileTree::FileTree(
+	const std::string &dir, size_t id, size_t nrfiles, size_t files_per_dir
+) : files_per_dir_(files_per_dir) {
+	std::string job_dir = dir + "/job" + std::to_string(id);
+	make_dir(dir);
+	make_dir(job_dir);
+	size_t num_dirs = (nrfiles + files_per_dir - 1) / files_per_dir;
+	for (size_t i = 0; i < num_dirs; ++i) {
+		std::string path = job_dir + "/d" + std::to_string(i);
+		make_dir(path);
+		int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+		if (fd == -1) {
+			perror("open");
+			rusty_panic("Failed to open %s", path.c_str());
+		}
+		dir_fds_.push_back(fd);
+	}
+}
+
+FileTree::FileTree(FileTree &&other)
+  : files_per_dir_(other.files_per_dir_),
+	dir_fds_(std::move(other.dir_fds_)) {
+	other.dir_fds_.clear();
+}
+
+FileTree::~FileTree() {
+	for (int fd : dir_fds_) {
+		close(fd);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef FILE_TREE_H_
+#define FILE_TREE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Creates the directory unless it exists already
+void make_dir(const std::string &path);
+
+// The files of a job, <dir>/job<id>/d<k>/f<i>, with files_per_dir files
+// per directory. The directories stay open so that files are opened
+// relative to them and their paths are not looked up on every op.
+class FileTree {
+public:
+	// Creates the directories. The files are left to the caller.
+	FileTree(
+		const std::string &dir, size_t id, size_t nrfiles,
+		size_t files_per_dir
+	);
+	FileTree(FileTree &&other);
+	FileTree(const FileTree &) = delete;
+	~FileTree();
+	size_t num_dirs() const { return dir_fds_.size(); }
+	// Directory d<k>
+	int dir(size_t k) const { return dir_fds_[k]; }
+	// Directory of the file
+	int dir_fd(size_t file) const {
+		return dir_fds_[file / files_per_dir_];
+	}
+	// Name of the file in its directory
+	static std::string file_name(size_t file) {
+		return "f" + std::to_string(file);
+	}
+
+private:
+	size_t files_per_dir_;
+	std::vector<int> dir_fds_;
+};
+
+#endif // FILE_TREE_H_
@@ -0,0 +1,46 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+void Histogram::reset() {
+	buckets_.fill(0);
+	count_ = 0;
+	max_ = 0;
+}
+
+void Histogram::merge(const Histogram &other) {
+	for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+		buckets_[i] += other.buckets_[i];
+	}
+	count_ += other.count_;
+	max_ = std::max(max_, other.max_);
+}
+
+uint64_t Histogram::percentile(double fraction) const {
+	if (count_ == 0) {
+		return 0;
+	}
+	uint64_t rank = std::max<uint64_t>(std::ceil(fraction * count_), 1);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+		seen += buckets_[i];
+		if (seen >= rank) {
+			return std::min(bucket_upper(i), max_);
+		}
+	}
+	return max_;
+}
+
+std::pair<uint64_t, uint64_t> Histogram::percentile_interval(
+	double fraction, double z
+) const {
+	if (count_ == 0) {
+		return {0, 0};
+	}
+	double half = z * std::sqrt(fraction * (1 - fraction) / count_);
+	return {
+		percentile(std::max(fraction - half, 0.0)),
+		percentile(std::min(fraction + half, 1.0)),
+	};
+}
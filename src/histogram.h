@@ -0,0 +1,78 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// z of a two-sided 95% confidence interval
+constexpr double Z_95 = 1.959964;
+
+// Log-linear histogram of non-negative values such as latencies in
+// nanoseconds. Values below 2^SUB_BUCKET_BITS get a bucket each. Larger
+// values are bucketed by their highest set bit and the SUB_BUCKET_BITS
+// bits below it, so the relative error is below 2^-SUB_BUCKET_BITS while
+// the whole 64-bit range fits in under a thousand buckets.
+class Histogram {
+public:
+	static constexpr size_t SUB_BUCKET_BITS = 4;
+	static constexpr size_t SUB_BUCKETS = (size_t)1 << SUB_BUCKET_BITS;
+	static constexpr size_t NUM_BUCKETS =
+		(64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	Histogram() { reset(); }
+	// Records n values equal to value
+	void record(uint64_t value, uint64_t n = 1) {
+		buckets_[bucket_of(value)] += n;
+		count_ += n;
+		if (value > max_) {
+			max_ = value;
+		}
+	}
+	void reset();
+	void merge(const Histogram &other);
+	uint64_t count() const { return count_; }
+	uint64_t max() const { return max_; }
+	uint64_t bucket_count(size_t bucket) const { return buckets_[bucket]; }
+	// Upper bound of the bucket containing the given fraction of values,
+	// capped at the maximum. 0 if empty.
+	uint64_t percentile(double fraction) const;
+	// Confidence interval of the percentile of the population the values
+	// were sampled from. The rank of the sample percentile is binomial, so
+	// the interval spans the ranks within z standard deviations of it.
+	std::pair<uint64_t, uint64_t> percentile_interval(
+		double fraction, double z
+	) const;
+
+	static size_t bucket_of(uint64_t value) {
+		if (value < SUB_BUCKETS) {
+			return value;
+		}
+		size_t shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+		return (shift + 1) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS;
+	}
+	// Smallest value in the bucket
+	static uint64_t bucket_lower(size_t bucket) {
+		if (bucket < SUB_BUCKETS) {
+			return bucket;
+		}
+		size_t shift = bucket / SUB_BUCKETS - 1;
+		return (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+	}
+	// Largest value in the bucket
+	static uint64_t bucket_upper(size_t bucket) {
+		if (bucket < SUB_BUCKETS) {
+			return bucket;
+		}
+		size_t shift = bucket / SUB_BUCKETS - 1;
+		return bucket_lower(bucket) + (((uint64_t)1 << shift) - 1);
+	}
+
+private:
+	std::array<uint64_t, NUM_BUCKETS> buckets_;
+	uint64_t count_;
+	uint64_t max_;
+};
+
+#endif // HISTOGRAM_H_
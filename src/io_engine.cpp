@@ -0,0 +1,334 @@
+#include "io_engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <rusty/macro.h>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class SyncEngine : public IOEngine {
+public:
+	SyncEngine() {}
+	SyncEngine(const SyncEngine &) = delete;
+	~SyncEngine() override {
+		for (int fd : file_slots_) {
+			if (fd != -1) {
+				close(fd);
+			}
+		}
+	}
+	void queue(const IOUnit &io) override { queued_.push_back(io); }
+	void submit() override {
+		bool cancel = false;
+		for (const IOUnit &io : queued_) {
+			ssize_t res;
+			if (cancel) {
+				res = -ECANCELED;
+			} else {
+				ssize_t ret;
+				do {
+					ret = sync_io(io);
+				} while (ret == -1 && errno == EINTR);
+				res = ret == -1 ? -errno : ret;
+			}
+			cancel = io.link && res < 0;
+			done_.push_back(IOCompletion{
+				.user_data = io.user_data,
+				.res = res,
+			});
+		}
+		queued_.clear();
+	}
+	void register_file_slots(size_t n) override {
+		file_slots_.resize(n, -1);
+	}
+	size_t reap(
+		IOCompletion *out, size_t, size_t max,
+		std::optional<rusty::time::Duration>
+	) override {
+		// Everything submitted has completed already
+		size_t n = std::min(max, done_.size());
+		std::copy(done_.begin(), done_.begin() + n, out);
+		done_.erase(done_.begin(), done_.begin() + n);
+		return n;
+	}
+
+private:
+	ssize_t sync_io(const IOUnit &io) {
+		int fd = io.file_slot < 0 ? io.fd : file_slots_[io.file_slot];
+		switch (io.op) {
+		case IOOp::Read:
+			return ::pread(fd, io.buf, io.len, io.offset);
+		case IOOp::Write:
+			return ::pwrite(fd, io.buf, io.len, io.offset);
+		case IOOp::Open: {
+			int ret = openat(io.fd, io.path, io.flags, 0644);
+			if (ret == -1 || io.file_slot < 0) {
+				return ret;
+			}
+			if (file_slots_[io.file_slot] != -1) {
+				close(file_slots_[io.file_slot]);
+			}
+			file_slots_[io.file_slot] = ret;
+			return 0;
+		}
+		case IOOp::Close:
+			if (io.file_slot >= 0) {
+				file_slots_[io.file_slot] = -1;
+			}
+			return ::close(fd);
+		}
+		rusty_panic("Unknown I/O op");
+	}
+
+	std::vector<IOUnit> queued_;
+	std::vector<IOCompletion> done_;
+	// fd of each file slot, -1 if empty
+	std::vector<int> file_slots_;
+};
+
+// Talks to io_uring through the raw system calls so that no extra library
+// is needed.
+class IoUringEngine : public IOEngine {
+public:
+	IoUringEngine(size_t depth) : to_submit_(0) {
+		struct io_uring_params p;
+		memset(&p, 0, sizeof(p));
+		ring_fd_ = syscall(__NR_io_uring_setup, depth, &p);
+		if (ring_fd_ == -1) {
+			perror("io_uring_setup");
+			rusty_panic();
+		}
+		rusty_assert(
+			p.features & IORING_FEAT_EXT_ARG,
+			"io_uring of this kernel does not support IORING_FEAT_EXT_ARG"
+		);
+		sq_map_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cq_map_size_ =
+			p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+		}
+		sq_ptr_ = mmap(
+			nullptr, sq_map_size_, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING
+		);
+		if (sq_ptr_ == MAP_FAILED) {
+			perror("mmap");
+			rusty_panic();
+		}
+		if (p.features & IORING_FEAT_SINGLE_MMAP) {
+			cq_ptr_ = sq_ptr_;
+		} else {
+			cq_ptr_ = mmap(
+				nullptr, cq_map_size_, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING
+			);
+			if (cq_ptr_ == MAP_FAILED) {
+				perror("mmap");
+				rusty_panic();
+			}
+		}
+		sqes_map_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+		sqes_ = (struct io_uring_sqe *)mmap(
+			nullptr, sqes_map_size_, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES
+		);
+		if (sqes_ == MAP_FAILED) {
+			perror("mmap");
+			rusty_panic();
+		}
+		char *sq = (char *)sq_ptr_;
+		sq_tail_ = (unsigned *)(sq + p.sq_off.tail);
+		sq_mask_ = *(unsigned *)(sq + p.sq_off.ring_mask);
+		sq_array_ = (unsigned *)(sq + p.sq_off.array);
+		char *cq = (char *)cq_ptr_;
+		cq_head_ = (unsigned *)(cq + p.cq_off.head);
+		cq_tail_ = (unsigned *)(cq + p.cq_off.tail);
+		cq_mask_ = *(unsigned *)(cq + p.cq_off.ring_mask);
+		cqes_ = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	}
+	~IoUringEngine() override {
+		munmap(sqes_, sqes_map_size_);
+		if (cq_ptr_ != sq_ptr_) {
+			munmap(cq_ptr_, cq_map_size_);
+		}
+		munmap(sq_ptr_, sq_map_size_);
+		close(ring_fd_);
+	}
+	void queue(const IOUnit &io) override {
+		// Only this thread writes the tail
+		unsigned tail = *sq_tail_;
+		unsigned index = tail & sq_mask_;
+		struct io_uring_sqe *sqe = &sqes_[index];
+		memset(sqe, 0, sizeof(*sqe));
+		switch (io.op) {
+		case IOOp::Read:
+		case IOOp::Write:
+			sqe->opcode = io.op == IOOp::Read ? IORING_OP_READ : IORING_OP_WRITE;
+			if (io.file_slot >= 0) {
+				sqe->fd = io.file_slot;
+				sqe->flags |= IOSQE_FIXED_FILE;
+			} else {
+				sqe->fd = io.fd;
+			}
+			sqe->addr = (uintptr_t)io.buf;
+			sqe->len = io.len;
+			sqe->off = io.offset;
+			break;
+		case IOOp::Open:
+			sqe->opcode = IORING_OP_OPENAT;
+			sqe->fd = io.fd;
+			sqe->addr = (uintptr_t)io.path;
+			sqe->len = 0644;
+			sqe->open_flags = io.flags;
+			if (io.file_slot >= 0) {
+				sqe->file_index = io.file_slot + 1;
+			}
+			break;
+		case IOOp::Close:
+			sqe->opcode = IORING_OP_CLOSE;
+			if (io.file_slot >= 0) {
+				sqe->file_index = io.file_slot + 1;
+			} else {
+				sqe->fd = io.fd;
+			}
+			break;
+		}
+		if (io.link) {
+			sqe->flags |= IOSQE_IO_LINK;
+		}
+		sqe->user_data = io.user_data;
+		sq_array_[index] = index;
+		__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+		to_submit_ += 1;
+	}
+	void submit() override {
+		while (to_submit_) {
+			int ret = enter(to_submit_, 0, 0, nullptr, 0);
+			if (ret == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (errno == EAGAIN || errno == EBUSY) {
+					// Out of resources or the CQ ring is full. The caller
+					// has to reap before the remaining I/Os can go.
+					break;
+				}
+				perror("io_uring_enter");
+				rusty_panic();
+			}
+			to_submit_ -= ret;
+		}
+	}
+	void register_file_slots(size_t n) override {
+		// Sparse slots, filled by Open
+		std::vector<int> fds(n, -1);
+		int ret = syscall(
+			__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES, fds.data(),
+			n
+		);
+		if (ret == -1) {
+			perror("io_uring_register");
+			rusty_panic();
+		}
+	}
+	size_t reap(
+		IOCompletion *out, size_t min, size_t max,
+		std::optional<rusty::time::Duration> timeout
+	) override {
+		size_t n = drain(out, max);
+		while (n < min) {
+			unsigned flags = IORING_ENTER_GETEVENTS;
+			struct __kernel_timespec ts;
+			struct io_uring_getevents_arg arg;
+			if (timeout.has_value()) {
+				uint64_t nanos = timeout.value().as_nanos();
+				ts.tv_sec = nanos / 1000000000;
+				ts.tv_nsec = nanos % 1000000000;
+				memset(&arg, 0, sizeof(arg));
+				arg.ts = (uintptr_t)&ts;
+				flags |= IORING_ENTER_EXT_ARG;
+			}
+			int ret = enter(
+				to_submit_, min - n, flags, timeout ? &arg : nullptr,
+				timeout ? sizeof(arg) : 0
+			);
+			if (ret == -1) {
+				if (errno == ETIME) {
+					n += drain(out + n, max - n);
+					break;
+				}
+				if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+					perror("io_uring_enter");
+					rusty_panic();
+				}
+			} else {
+				to_submit_ -= ret;
+			}
+			n += drain(out + n, max - n);
+		}
+		return n;
+	}
+
+private:
+	int enter(
+		unsigned to_submit, unsigned min_complete, unsigned flags, void *arg,
+		size_t argsz
+	) {
+		return syscall(
+			__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg,
+			argsz
+		);
+	}
+	size_t drain(IOCompletion *out, size_t max) {
+		// Only this thread writes the head
+		unsigned head = *cq_head_;
+		unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+		size_t n = 0;
+		while (head != tail && n < max) {
+			const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+			out[n++] = IOCompletion{
+				.user_data = cqe.user_data,
+				.res = cqe.res,
+			};
+			head += 1;
+		}
+		__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+		return n;
+	}
+
+	int ring_fd_;
+	void *sq_ptr_;
+	void *cq_ptr_;
+	size_t sq_map_size_;
+	size_t cq_map_size_;
+	size_t sqes_map_size_;
+	unsigned *sq_tail_;
+	unsigned sq_mask_;
+	unsigned *sq_array_;
+	struct io_uring_sqe *sqes_;
+	unsigned *cq_head_;
+	unsigned *cq_tail_;
+	unsigned cq_mask_;
+	struct io_uring_cqe *cqes_;
+	// Queued but not yet accepted by the kernel
+	unsigned to_submit_;
+};
+
+std::unique_ptr<IOEngine> new_io_engine(IOEngineType type, size_t depth) {
+	switch (type) {
+	case IOEngineType::Sync:
+		return std::make_unique<SyncEngine>();
+	case IOEngineType::IoUring:
+		return std::make_unique<IoUringEngine>(depth);
+	}
+	rusty_panic("Unknown I/O engine");
+}
@@ -0,0 +1,72 @@
+#ifndef IO_ENGINE_H_
+#define IO_ENGINE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <rusty/time.h>
+#include <sys/types.h>
+
+enum class IOEngineType {
+	// pread/pwrite. Every I/O is done in submit().
+	Sync,
+	IoUring,
+};
+
+enum class IOOp {
+	Read,
+	Write,
+	// Opens path relative to the directory fd. The result is the new fd,
+	// or 0 if it goes to a file slot.
+	Open,
+	Close,
+};
+
+struct IOUnit {
+	IOOp op;
+	int fd;
+	char *buf;
+	size_t len;
+	size_t offset;
+	// Returned as is in the completion
+	uint64_t user_data;
+	// Of Open
+	const char *path = nullptr;
+	int flags = 0;
+	// If not negative, the I/O is on this file slot instead of fd, and Open
+	// puts the file into it
+	int file_slot = -1;
+	// The next I/O queued starts once this one has succeeded. If this one
+	// fails, the next one fails with ECANCELED.
+	bool link = false;
+};
+
+struct IOCompletion {
+	uint64_t user_data;
+	// Number of bytes transferred, or -errno
+	ssize_t res;
+};
+
+class IOEngine {
+public:
+	virtual ~IOEngine() = default;
+	// Queues an I/O without submitting it. The caller makes sure that no
+	// more than the depth of the engine I/Os are queued or in flight.
+	virtual void queue(const IOUnit &io) = 0;
+	// Submits all queued I/Os
+	virtual void submit() = 0;
+	// Sets up n file slots. Open can then put files into them, so that the
+	// I/Os linked after an Open can use the file.
+	virtual void register_file_slots(size_t n) = 0;
+	// Reaps at most max completions into out. Waits until at least min
+	// completions are available or the timeout expires.
+	virtual size_t reap(
+		IOCompletion *out, size_t min, size_t max,
+		std::optional<rusty::time::Duration> timeout
+	) = 0;
+};
+
+std::unique_ptr<IOEngine> new_io_engine(IOEngineType type, size_t depth);
+
+#endif // IO_ENGINE_H_
@@ -0,0 +1,25 @@
+#include "io_error.h"
+
+#include <cstring>
+#include <rusty/macro.h>
+
+bool tolerates_error(ContinueOnError continue_on_error, IOOp op) {
+	switch (continue_on_error) {
+	case ContinueOnError::None:
+		return false;
+	case ContinueOnError::Read:
+		return op == IOOp::Read;
+	case ContinueOnError::Write:
+		return op == IOOp::Write;
+	case ContinueOnError::All:
+		return true;
+	}
+	rusty_panic();
+}
+
+std::string error_name(int err) {
+	if (err == 0) {
+		return "unexpected end of file";
+	}
+	return std::string(strerror(err)) + " (errno " + std::to_string(err) + ")";
+}
@@ -0,0 +1,22 @@
+#ifndef IO_ERROR_H_
+#define IO_ERROR_H_
+
+#include <string>
+
+#include "io_engine.h"
+
+// I/Os of these types that fail are counted instead of aborting the run
+enum class ContinueOnError {
+	None,
+	Read,
+	Write,
+	All,
+};
+
+// Whether a failed I/O of op is counted instead of aborting the run
+bool tolerates_error(ContinueOnError continue_on_error, IOOp op);
+
+// 0 stands for an unexpected end of file
+std::string error_name(int err);
+
+#endif // IO_ERROR_H_
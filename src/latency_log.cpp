@@ -0,0 +1,58 @@
+#include "latency_log.h"
+
+#include <cinttypes>
+#include <rusty/macro.h>
+
+LatencyLog::LatencyLog(const std::string &path, uint64_t window_ns)
+  : window_ns_(window_ns), window_start_ns_(0) {
+	file_ = fopen(path.c_str(), "w");
+	if (file_ == nullptr) {
+		perror("fopen");
+		rusty_panic("Failed to open latency log %s", path.c_str());
+	}
+	fprintf(
+		file_,
+		"# start_ms,window_ms,count,max_ns,lower_ns:count,...\n"
+	);
+}
+
+LatencyLog::~LatencyLog() {
+	if (fclose(file_) != 0) {
+		perror("fclose");
+	}
+}
+
+void LatencyLog::finish(uint64_t now_ns) {
+	rotate(now_ns);
+	if (now_ns > window_start_ns_ && histogram_.count()) {
+		write_window(now_ns - window_start_ns_);
+	}
+	fflush(file_);
+}
+
+void LatencyLog::rotate(uint64_t now_ns) {
+	while (now_ns >= window_start_ns_ + window_ns_) {
+		write_window(window_ns_);
+		histogram_.reset();
+		window_start_ns_ += window_ns_;
+	}
+}
+
+void LatencyLog::write_window(uint64_t length_ns) {
+	fprintf(
+		file_, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+		window_start_ns_ / 1000000, length_ns / 1000000, histogram_.count(),
+		histogram_.max()
+	);
+	if (histogram_.count()) {
+		for (size_t i = 0; i < Histogram::NUM_BUCKETS; ++i) {
+			uint64_t n = histogram_.bucket_count(i);
+			if (n) {
+				fprintf(
+					file_, ",%" PRIu64 ":%" PRIu64, Histogram::bucket_lower(i), n
+				);
+			}
+		}
+	}
+	fputc('\n', file_);
+}
@@ -0,0 +1,44 @@
+#ifndef LATENCY_LOG_H_
+#define LATENCY_LOG_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "histogram.h"
+
+// Writes the latencies of a job as one histogram per window instead of one
+// line per I/O, so that the log of a run of days stays small. Each line is
+//
+//   start_ms,window_ms,count,max_ns,lower_ns:count,lower_ns:count,...
+//
+// where the pairs list the non-empty buckets of the histogram in order,
+// each covering values from lower_ns up to the lower_ns of the next
+// possible bucket. Windows without I/Os are written with a count of 0.
+class LatencyLog {
+public:
+	LatencyLog(const std::string &path, uint64_t window_ns);
+	LatencyLog(const LatencyLog &) = delete;
+	~LatencyLog();
+	// now_ns is the time since the start of the job
+	void record(uint64_t now_ns, uint64_t latency_ns) {
+		if (now_ns >= window_start_ns_ + window_ns_) {
+			rotate(now_ns);
+		}
+		histogram_.record(latency_ns);
+	}
+	// Writes the last, possibly partial, window
+	void finish(uint64_t now_ns);
+
+private:
+	// Writes the windows that ended before now_ns
+	void rotate(uint64_t now_ns);
+	void write_window(uint64_t length_ns);
+
+	FILE *file_;
+	uint64_t window_ns_;
+	uint64_t window_start_ns_;
+	Histogram histogram_;
+};
+
+#endif // LATENCY_LOG_H_
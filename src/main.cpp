@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <array>
+#include <barrier>
 #include <boost/program_options/errors.hpp>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/parsers.hpp>
@@ -6,22 +8,57 @@
 #include <cctype>
 #include <chrono>
 #include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <rusty/macro.h>
 #include <rusty/time.h>
 #include <thread>
 
 #include <fcntl.h>
+#include <linux/blkzoned.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "batch_rng.h"
+#include "clock.h"
+#include "compare.h"
+#include "executor.h"
+#include "faulty_engine.h"
+#include "histogram.h"
+#include "io_engine.h"
+#include "io_error.h"
+#include "latency_log.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "pacing.h"
+#include "precondition.h"
+#include "result.h"
+#include "small_files.h"
+
 using seed_t = std::mt19937_64::result_type;
 
 enum class IOType {
 	RandRead,
 	Read,
 	Write,
+	RandWrite,
+	// Every write is followed by a read of the same block
+	ReadAfterWrite,
+	// Chains of dependent reads starting at a random block. The next block
+	// of a chain is derived from the data of the previous read.
+	PointerChase,
+	// Updates of bs bytes at random blocks, each a read of the
+	// rmw_align-aligned range around the block and a write of it
+	ReadModifyWrite,
 };
 
 std::optional<size_t> parse_size(const char *start, size_t n) {
@@ -73,61 +110,823 @@ std::optional<size_t> parse_size(const char *start, size_t n) {
 	return size * size_unit;
 }
 
+// How read/write pick the next block. Forward is the plain contiguous
+// pattern that read/write use by default.
+enum class SequencerType {
+	Forward,
+	// Sequential with a gap of stride_blocks blocks between two I/Os
+	Stride,
+	Reverse,
+	// seq_pct percent of the I/Os belong to forward runs of run_len blocks
+	// starting at a random block, the rest hit a single random block.
+	Mixed,
+};
+
+struct Sequencer {
+	SequencerType type;
+	size_t stride_blocks;
+	double seq_pct;
+	size_t run_len;
+};
+
+// stride:N | reverse | mixed:seqpct[:run_len]
+std::optional<Sequencer> parse_sequencer(const std::string &s, size_t bs) {
+	Sequencer seq{
+		.type = SequencerType::Forward,
+		.stride_blocks = 0,
+		.seq_pct = 0,
+		.run_len = 16,
+	};
+	size_t colon = s.find(':');
+	std::string name = s.substr(0, colon);
+	std::string arg;
+	if (colon != std::string::npos) {
+		arg = s.substr(colon + 1);
+	}
+	if (name == "reverse") {
+		if (colon != std::string::npos) {
+			return std::nullopt;
+		}
+		seq.type = SequencerType::Reverse;
+	} else if (name == "stride") {
+		auto skip = parse_size(arg.data(), arg.size());
+		if (!skip.has_value() || skip.value() % bs != 0) {
+			return std::nullopt;
+		}
+		seq.type = SequencerType::Stride;
+		seq.stride_blocks = skip.value() / bs;
+	} else if (name == "mixed") {
+		size_t colon2 = arg.find(':');
+		std::string pct = arg.substr(0, colon2);
+		try {
+			size_t pos;
+			seq.seq_pct = std::stod(pct, &pos);
+			if (pos != pct.size()) {
+				return std::nullopt;
+			}
+			if (colon2 != std::string::npos) {
+				std::string len = arg.substr(colon2 + 1);
+				seq.run_len = std::stoul(len, &pos);
+				if (pos != len.size()) {
+					return std::nullopt;
+				}
+			}
+		} catch (const std::logic_error &) {
+			return std::nullopt;
+		}
+		if (seq.seq_pct < 0 || seq.seq_pct > 100 || seq.run_len == 0) {
+			return std::nullopt;
+		}
+		seq.type = SequencerType::Mixed;
+	} else {
+		return std::nullopt;
+	}
+	return seq;
+}
+
+// Splits s at the colons and parses each part as a number
+static std::optional<std::vector<double>> parse_numbers(const std::string &s) {
+	std::vector<double> numbers;
+	size_t begin = 0;
+	for (;;) {
+		size_t colon = s.find(':', begin);
+		std::string part = s.substr(begin, colon - begin);
+		try {
+			size_t pos;
+			numbers.push_back(std::stod(part, &pos));
+			if (pos != part.size()) {
+				return std::nullopt;
+			}
+		} catch (const std::logic_error &) {
+			return std::nullopt;
+		}
+		if (colon == std::string::npos) {
+			return numbers;
+		}
+		begin = colon + 1;
+	}
+}
+
+// none | fixed:usec | uniform:min_usec:max_usec | exp:mean_usec |
+// lognormal:median_usec:sigma
+std::optional<LatencyDistribution> parse_latency_distribution(
+	const std::string &s
+) {
+	LatencyDistribution d{
+		.type = LatencyDistributionType::None,
+		.a = 0,
+		.b = 0,
+	};
+	if (s == "none") {
+		return d;
+	}
+	size_t colon = s.find(':');
+	if (colon == std::string::npos) {
+		return std::nullopt;
+	}
+	std::string name = s.substr(0, colon);
+	auto args = parse_numbers(s.substr(colon + 1));
+	if (!args.has_value()) {
+		return std::nullopt;
+	}
+	const std::vector<double> &v = args.value();
+	if (name == "fixed" && v.size() == 1 && v[0] >= 0) {
+		d.type = LatencyDistributionType::Fixed;
+		d.a = v[0] * 1000;
+	} else if (
+		name == "uniform" && v.size() == 2 && v[0] >= 0 && v[0] <= v[1]
+	) {
+		d.type = LatencyDistributionType::Uniform;
+		d.a = v[0] * 1000;
+		d.b = v[1] * 1000;
+	} else if (name == "exp" && v.size() == 1 && v[0] > 0) {
+		d.type = LatencyDistributionType::Exponential;
+		d.a = v[0] * 1000;
+	} else if (
+		name == "lognormal" && v.size() == 2 && v[0] > 0 && v[1] >= 0
+	) {
+		d.type = LatencyDistributionType::LogNormal;
+		d.a = v[0] * 1000;
+		d.b = v[1];
+	} else {
+		return std::nullopt;
+	}
+	return d;
+}
+
+// fixed:size | uniform:min:max | lognormal:median:sigma:max, with sizes
+// as in bs
+std::optional<FileSizeDistribution> parse_file_size_distribution(
+	const std::string &s
+) {
+	std::vector<std::string> parts;
+	size_t begin = 0;
+	for (;;) {
+		size_t colon = s.find(':', begin);
+		parts.push_back(s.substr(begin, colon - begin));
+		if (colon == std::string::npos) {
+			break;
+		}
+		begin = colon + 1;
+	}
+	auto size_at = [&parts](size_t i) {
+		return parse_size(parts[i].data(), parts[i].size());
+	};
+	if (parts[0] == "fixed" && parts.size() == 2) {
+		auto size = size_at(1);
+		if (!size.has_value() || size.value() == 0) {
+			return std::nullopt;
+		}
+		return FileSizeDistribution{
+			.type = FileSizeDistributionType::Fixed,
+			.a = (double)size.value(),
+			.b = 0,
+			.max = size.value(),
+		};
+	}
+	if (parts[0] == "uniform" && parts.size() == 3) {
+		auto min = size_at(1);
+		auto max = size_at(2);
+		if (
+			!min.has_value() || !max.has_value() || min.value() == 0 ||
+			min.value() > max.value()
+		) {
+			return std::nullopt;
+		}
+		return FileSizeDistribution{
+			.type = FileSizeDistributionType::Uniform,
+			.a = (double)min.value(),
+			.b = (double)max.value(),
+			.max = max.value(),
+		};
+	}
+	if (parts[0] == "lognormal" && parts.size() == 4) {
+		auto median = size_at(1);
+		auto sigma = parse_numbers(parts[2]);
+		auto max = size_at(3);
+		if (
+			!median.has_value() || !sigma.has_value() || !max.has_value() ||
+			median.value() == 0 || sigma.value()[0] < 0 ||
+			median.value() > max.value()
+		) {
+			return std::nullopt;
+		}
+		return FileSizeDistribution{
+			.type = FileSizeDistributionType::LogNormal,
+			.a = (double)median.value(),
+			.b = sigma.value()[0],
+			.max = max.value(),
+		};
+	}
+	return std::nullopt;
+}
+
+std::optional<IOType> parse_io_type(const std::string &s) {
+	if (s == "randread") {
+		return IOType::RandRead;
+	} else if (s == "read") {
+		return IOType::Read;
+	} else if (s == "write") {
+		return IOType::Write;
+	} else if (s == "randwrite") {
+		return IOType::RandWrite;
+	} else if (s == "readafterwrite") {
+		return IOType::ReadAfterWrite;
+	} else if (s == "pointerchase") {
+		return IOType::PointerChase;
+	} else if (s == "readmodifywrite") {
+		return IOType::ReadModifyWrite;
+	}
+	return std::nullopt;
+}
+
+const char *io_type_name(IOType io_type) {
+	switch (io_type) {
+	case IOType::RandRead:
+		return "randread";
+	case IOType::Read:
+		return "read";
+	case IOType::Write:
+		return "write";
+	case IOType::RandWrite:
+		return "randwrite";
+	case IOType::ReadAfterWrite:
+		return "readafterwrite";
+	case IOType::PointerChase:
+		return "pointerchase";
+	case IOType::ReadModifyWrite:
+		return "readmodifywrite";
+	}
+	rusty_panic();
+}
+
+// xxxB/s, with xxx as in bs
+std::optional<size_t> parse_bandwidth(const std::string &s) {
+	if (s.size() < 4 || s.substr(s.size() - 3) != "B/s") {
+		return std::nullopt;
+	}
+	return parse_size(s.data(), s.size() - 2);
+}
+
+// The values each parameter takes in --sweep. A parameter that is not
+// swept has the single value of its own option.
+struct Sweep {
+	std::vector<IOType> io_types;
+	std::vector<size_t> bs;
+	std::vector<std::optional<size_t>> bandwidth;
+	std::vector<size_t> numjobs;
+	std::vector<size_t> iodepth;
+};
+
+// param=value,value,... with param in readwrite/bs/bandwidth/numjobs/
+// iodepth. A bandwidth of none means unpaced.
+static bool parse_sweep(const std::string &s, Sweep &sweep) {
+	size_t eq = s.find('=');
+	if (eq == std::string::npos) {
+		return false;
+	}
+	std::string param = s.substr(0, eq);
+	std::vector<std::string> values;
+	size_t begin = eq + 1;
+	for (;;) {
+		size_t comma = s.find(',', begin);
+		values.push_back(s.substr(begin, comma - begin));
+		if (comma == std::string::npos) {
+			break;
+		}
+		begin = comma + 1;
+	}
+	auto number = [](const std::string &v) -> std::optional<size_t> {
+		try {
+			size_t pos;
+			size_t n = std::stoul(v, &pos);
+			if (pos != v.size() || n == 0) {
+				return std::nullopt;
+			}
+			return n;
+		} catch (const std::logic_error &) {
+			return std::nullopt;
+		}
+	};
+	if (param == "readwrite") {
+		sweep.io_types.clear();
+		for (const std::string &v : values) {
+			auto io_type = parse_io_type(v);
+			if (!io_type.has_value()) {
+				return false;
+			}
+			sweep.io_types.push_back(io_type.value());
+		}
+	} else if (param == "bs") {
+		sweep.bs.clear();
+		for (const std::string &v : values) {
+			auto bs = parse_size(v.data(), v.size());
+			if (!bs.has_value() || bs.value() == 0) {
+				return false;
+			}
+			sweep.bs.push_back(bs.value());
+		}
+	} else if (param == "bandwidth") {
+		sweep.bandwidth.clear();
+		for (const std::string &v : values) {
+			if (v == "none") {
+				sweep.bandwidth.push_back(std::nullopt);
+				continue;
+			}
+			auto bandwidth = parse_bandwidth(v);
+			if (!bandwidth.has_value()) {
+				return false;
+			}
+			sweep.bandwidth.push_back(bandwidth.value());
+		}
+	} else if (param == "numjobs" || param == "iodepth") {
+		std::vector<size_t> &out =
+			param == "numjobs" ? sweep.numjobs : sweep.iodepth;
+		out.clear();
+		for (const std::string &v : values) {
+			auto n = number(v);
+			if (!n.has_value()) {
+				return false;
+			}
+			out.push_back(n.value());
+		}
+	} else {
+		return false;
+	}
+	return true;
+}
+
+struct Zone {
+	size_t first_block;
+	size_t num_blocks;
+};
+
+// Random draws pick a zone by the percentage of I/O it receives, then a
+// block uniformly inside the zone. zone_of_pct maps each of the 100
+// percent slots to its zone so that picking a zone is a single lookup.
+struct ZoneTable {
+	std::vector<Zone> zones;
+	std::array<uint8_t, 100> zone_of_pct;
+};
+
+// pct_io/pct_space,pct_io/pct_space,...
+// Both pct_io and pct_space must sum up to 100.
+std::optional<ZoneTable> parse_zones(const std::string &s, size_t num_blocks) {
+	ZoneTable table;
+	size_t io_sum = 0;
+	size_t space_sum = 0;
+	size_t start = 0;
+	for (;;) {
+		if (table.zones.size() == 100) {
+			return std::nullopt;
+		}
+		size_t comma = s.find(',', start);
+		std::string zone = s.substr(start, comma - start);
+		size_t slash = zone.find('/');
+		if (slash == std::string::npos) {
+			return std::nullopt;
+		}
+		size_t pct_io, pct_space;
+		try {
+			size_t pos;
+			pct_io = std::stoul(zone.substr(0, slash), &pos);
+			if (pos != slash) {
+				return std::nullopt;
+			}
+			std::string space = zone.substr(slash + 1);
+			pct_space = std::stoul(space, &pos);
+			if (pos != space.size()) {
+				return std::nullopt;
+			}
+		} catch (const std::logic_error &) {
+			return std::nullopt;
+		}
+		if (pct_io > 100 - io_sum || pct_space > 100 - space_sum) {
+			return std::nullopt;
+		}
+		size_t first_block = num_blocks * space_sum / 100;
+		space_sum += pct_space;
+		size_t end_block = num_blocks * space_sum / 100;
+		if (pct_io != 0) {
+			if (end_block == first_block) {
+				return std::nullopt;
+			}
+			std::fill_n(
+				table.zone_of_pct.begin() + io_sum, pct_io, table.zones.size()
+			);
+		}
+		io_sum += pct_io;
+		table.zones.push_back(Zone{
+			.first_block = first_block,
+			.num_blocks = end_block - first_block,
+		});
+		if (comma == std::string::npos) {
+			break;
+		}
+		start = comma + 1;
+	}
+	if (io_sum != 100 || space_sum != 100) {
+		return std::nullopt;
+	}
+	return table;
+}
+
+enum class ZoneMode {
+	None,
+	// Regular file or block device split into zones of zone_size bytes.
+	// Zones are reset by punching holes.
+	Emulated,
+	// Zoned block device. Zone size, capacities and write pointers are
+	// reported by the device.
+	Zbd,
+};
+
 struct Options {
 	// Allocated buffer should align to blksize
 	size_t blksize;
 
 	std::optional<size_t> bandwidth;
 	size_t bs;
+	// Random I/Os start at multiples of block_align in the I/O region
+	size_t block_align;
 	IOType io_type;
 	size_t num_blocks;
+	// Number of I/Os per job. Sequential I/O wraps around at the end of the
+	// I/O region.
+	size_t num_ops;
+	// Number of streams per job
+	size_t streams;
+	Sequencer sequencer;
+	// Job i does I/O in [offset + i * offset_increment,
+	// offset + i * offset_increment + num_blocks * bs)
+	size_t offset;
+	size_t offset_increment;
+	std::optional<ZoneTable> zones;
+	ZoneMode zone_mode;
+	size_t zone_size;
+	size_t max_open_zones;
+	IOEngineType io_engine;
+	size_t iodepth;
+	size_t iodepth_batch_submit;
+	size_t iodepth_batch_complete_min;
+	size_t iodepth_batch_complete_max;
+	// Number of I/Os per chunk in work stealing mode
+	size_t work_chunk_ops;
+	// Job i logs latency histograms to <lat_log>_lat.<i>.log
+	std::optional<std::string> lat_log;
+	uint64_t lat_log_window_ns;
+	// The latency of an I/O is recorded with probability 1 / lat_sampling.
+	// Counts of I/Os and bytes are exact.
+	size_t lat_sampling;
+	ContinueOnError continue_on_error;
+	// A failed I/O is retried up to io_retries times. The first retry waits
+	// retry_backoff_ns, and each further one twice as long as the last.
+	size_t io_retries;
+	uint64_t retry_backoff_ns;
+	// The run is aborted once a job has more failed I/Os than this
+	std::optional<size_t> max_errors;
+	// If set, io_engine is wrapped by the faulty engine
+	std::optional<FaultConfig> faults;
+	// Delay between a write and the read of the same block
+	uint64_t raw_delay_ns;
+	// Number of reads per pointer chasing chain
+	size_t chase_depth;
+	// readmodifywrite reads and writes whole units of this size
+	size_t rmw_align;
 };
 
-class Worker {
+// Hands out write offsets that respect sequential-write-required zones.
+// Up to max_open_zones zones are written round-robin, each at its write
+// pointer. A full zone is replaced by the next zone that is not open,
+// which is reset first if it holds data.
+class ZonedWriter {
 public:
-	Worker(const Options &options, int fd, seed_t seed)
+	ZonedWriter(const Options &options, int fd, size_t base_offset)
 	  : options_(options),
 		fd_(fd),
+		base_offset_(base_offset),
+		num_zones_(options_.num_blocks * options_.bs / options_.zone_size),
+		wp_(num_zones_, 0),
+		capacity_(num_zones_, options_.zone_size),
+		conventional_(num_zones_, false),
+		is_open_(num_zones_, false),
+		cursor_(0),
+		next_zone_(0) {
+		if (options_.zone_mode == ZoneMode::Zbd) {
+			report_zones();
+		}
+		size_t num_open = std::min(options_.max_open_zones, num_zones_);
+		for (size_t i = 0; i < num_open; ++i) {
+			open_.push_back(open_next_zone());
+		}
+	}
+	size_t next_offset() {
+		size_t zone = open_[cursor_];
+		size_t offset = zone_start(zone) + wp_[zone];
+		wp_[zone] += options_.bs;
+		if (wp_[zone] + options_.bs > capacity_[zone]) {
+			is_open_[zone] = false;
+			open_[cursor_] = open_next_zone();
+		}
+		cursor_ = (cursor_ + 1) % open_.size();
+		return offset;
+	}
+
+private:
+	size_t zone_start(size_t zone) const {
+		return base_offset_ + zone * options_.zone_size;
+	}
+	size_t open_next_zone() {
+		while (is_open_[next_zone_]) {
+			next_zone_ = (next_zone_ + 1) % num_zones_;
+		}
+		size_t zone = next_zone_;
+		next_zone_ = (next_zone_ + 1) % num_zones_;
+		if (wp_[zone] != 0) {
+			reset_zone(zone);
+		}
+		is_open_[zone] = true;
+		return zone;
+	}
+	void reset_zone(size_t zone) {
+		switch (options_.zone_mode) {
+		case ZoneMode::None:
+			rusty_panic("Resetting a zone without zonemode");
+		case ZoneMode::Emulated:
+			if (fallocate(
+				fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				zone_start(zone), options_.zone_size
+			) == -1) {
+				// Not every file system or device can punch holes.
+				// Overwriting the zone is fine for emulated zones anyway.
+				if (errno != EOPNOTSUPP) {
+					perror("fallocate");
+					rusty_panic();
+				}
+			}
+			break;
+		case ZoneMode::Zbd:
+			if (!conventional_[zone]) {
+				struct blk_zone_range range {
+					.sector = zone_start(zone) >> 9,
+					.nr_sectors = options_.zone_size >> 9,
+				};
+				if (ioctl(fd_, BLKRESETZONE, &range) == -1) {
+					perror("ioctl BLKRESETZONE");
+					rusty_panic();
+				}
+			}
+			break;
+		}
+		wp_[zone] = 0;
+	}
+	void report_zones() {
+		std::vector<char> buf(
+			sizeof(struct blk_zone_report) +
+				num_zones_ * sizeof(struct blk_zone)
+		);
+		struct blk_zone_report *report = (struct blk_zone_report *)buf.data();
+		size_t done = 0;
+		while (done < num_zones_) {
+			report->sector = zone_start(done) >> 9;
+			report->nr_zones = num_zones_ - done;
+			if (ioctl(fd_, BLKREPORTZONE, report) == -1) {
+				perror("ioctl BLKREPORTZONE");
+				rusty_panic();
+			}
+			rusty_assert(report->nr_zones != 0);
+			for (size_t i = 0; i < report->nr_zones; ++i, ++done) {
+				const struct blk_zone &z = report->zones[i];
+				if (z.type == BLK_ZONE_TYPE_CONVENTIONAL) {
+					// No write pointer, start at the beginning.
+					conventional_[done] = true;
+					wp_[done] = 0;
+				} else {
+					wp_[done] = (z.wp - z.start) << 9;
+				}
+				if (report->flags & BLK_ZONE_REP_CAPACITY) {
+					capacity_[done] = z.capacity << 9;
+				}
+			}
+		}
+	}
+
+	const Options &options_;
+	int fd_;
+	size_t base_offset_;
+	size_t num_zones_;
+	// Bytes written in each zone
+	std::vector<size_t> wp_;
+	// Writable bytes in each zone
+	std::vector<size_t> capacity_;
+	std::vector<bool> conventional_;
+	std::vector<bool> is_open_;
+	std::vector<size_t> open_;
+	// Index into open_ of the zone to write next
+	size_t cursor_;
+	// Where to look for the next zone to open
+	size_t next_zone_;
+};
+
+// Random blocks are drawn in batches of this size
+constexpr size_t BLOCK_RING_SIZE = 128;
+// Delay from the moment all jobs are ready to the common start time
+constexpr uint64_t START_DELAY_NS = 10000000;
+// Consecutive EAGAINs of an I/O that count as one failed attempt
+constexpr size_t MAX_EAGAIN = 100;
+// One of the iodepth I/Os a worker can have in flight
+struct IOSlot {
+	char *buf;
+	IOOp op;
+	// I/O region of the stream that issued the I/O
+	size_t base_offset;
+	size_t offset;
+	// bs, except in readmodifywrite
+	size_t len;
+	// Start of the bytes updated by readmodifywrite
+	size_t update_offset;
+	// Bytes transferred so far. Short reads and writes are resubmitted.
+	size_t done;
+	// Number of dependent I/Os still to do after this one
+	size_t chain_left;
+	// Whether the latency of the I/O is recorded
+	bool sampled;
+	// Executor time. Only taken if sampled, or for the first I/O.
+	uint64_t issue_ns;
+};
+
+// An independently paced sequence of I/Os over its own I/O region. A
+// worker multiplexes all its streams on one thread and one engine.
+struct Stream {
+	size_t base_offset;
+	size_t next_block;
+	// Blocks left in the current run of the mixed sequencer
+	size_t run_remaining;
+	std::optional<ZonedWriter> zoned_writer;
+	size_t ops_left;
+	// Next pacing tick in nanoseconds since the worker started
+	uint64_t next_ns;
+};
+
+// A range of I/Os in the I/O region of a stream, the unit of work that
+// workers steal from each other
+struct WorkChunk {
+	size_t base_offset;
+	size_t first_block;
+	size_t num_ops;
+};
+
+// Per-worker deques of work chunks. A worker takes chunks from the front
+// of its own deque, and steals from the back of the others' once its own
+// deque runs dry. Fast workers thus keep going until all work is done.
+class WorkPool {
+public:
+	WorkPool(size_t num_workers) : queues_(num_workers) {}
+	void push(size_t worker, const WorkChunk &chunk) {
+		Queue &q = queues_[worker];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.chunks.push_back(chunk);
+	}
+	std::optional<WorkChunk> take(size_t worker) {
+		{
+			Queue &q = queues_[worker];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if (!q.chunks.empty()) {
+				WorkChunk chunk = q.chunks.front();
+				q.chunks.pop_front();
+				return chunk;
+			}
+		}
+		for (size_t i = 1; i < queues_.size(); ++i) {
+			Queue &q = queues_[(worker + i) % queues_.size()];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if (!q.chunks.empty()) {
+				WorkChunk chunk = q.chunks.back();
+				q.chunks.pop_back();
+				return chunk;
+			}
+		}
+		return std::nullopt;
+	}
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<WorkChunk> chunks;
+	};
+	std::vector<Queue> queues_;
+};
+
+// Workers sit next to each other in a vector. Aligning them keeps the
+// state that one worker writes off the cache lines of its neighbours.
+class alignas(CACHE_LINE_SIZE) Worker {
+public:
+	// If work_pool is not null, the I/Os of the streams are put into the
+	// pool in chunks of work_chunk_ops and may be done by other workers.
+	// metrics may be read by other threads while the worker runs.
+	Worker(
+		const Options &options, size_t id, int fd, seed_t seed,
+		WorkPool *work_pool, JobMetrics &metrics
+	) : options_(options),
+		id_(id),
+		fd_(fd),
+		work_pool_(work_pool),
+		metrics_(metrics),
 		rng_(seed),
-		buf_(options_.bs + options_.blksize - 1),
+		batch_rng_(rng_()),
+		ring_pos_(BLOCK_RING_SIZE),
+		sample_skip_(0),
+		buf_(options_.iodepth * slot_buf_size() + options_.blksize - 1),
 		aligned_buf_((char *)(
 			((uintptr_t)buf_.data() + options_.blksize - 1) &
 				~(uintptr_t)(options_.blksize - 1)
 		)),
-		block_dist(0, options_.num_blocks - 1),
+		executor_(
+			new_engine(),
+			options_.iodepth, options_.iodepth_batch_complete_min,
+			options_.iodepth_batch_complete_max
+		),
+		ops_done_(0),
+		io_bytes_(0),
 		io_time_(rusty::time::Duration::from_nanos(0)),
-		run_time_(rusty::time::Duration::from_nanos(0)) {}
-	void run() {
-		rusty::time::Instant start = rusty::time::Instant::now();
-		if (options_.bandwidth.has_value()) {
-			rusty::time::Duration interval = rusty::time::Duration::from_nanos(
-				options_.bs * 1e9 / options_.bandwidth.value()
+		run_time_(rusty::time::Duration::from_nanos(0)),
+		num_errors_(0) {
+		if (options_.lat_sampling > 1) {
+			sample_skip_ = next_sample_skip();
+		}
+		if (options_.lat_log.has_value()) {
+			lat_log_ = std::make_unique<LatencyLog>(
+				options_.lat_log.value() + "_lat." + std::to_string(id) +
+					".log",
+				options_.lat_log_window_ns
 			);
-			rusty::time::Instant next_begin =
-				rusty::time::Instant::now() + interval;
-			size_t num_op = options_.num_blocks;
-			while (num_op) {
-				num_op -= 1;
-				rw_one_block();
-				std::optional<rusty::time::Duration> sleep_time =
-					next_begin.checked_duration_since(
-						rusty::time::Instant::now()
-					);
-				if (sleep_time.has_value()) {
-					std::this_thread::sleep_for(
-						std::chrono::nanoseconds(sleep_time.value().as_nanos())
-					);
-				}
-				next_begin += interval;
+		}
+		if (
+			options_.io_type != IOType::RandRead &&
+			options_.io_type != IOType::Read &&
+			options_.io_type != IOType::PointerChase
+		) {
+			fill_buf();
+		}
+		for (size_t i = 0; i < options_.iodepth; ++i) {
+			slots_.push_back(IOSlot{
+				.buf = aligned_buf_ + i * slot_buf_size(),
+				.op = IOOp::Read,
+				.base_offset = 0,
+				.offset = 0,
+				.len = 0,
+				.update_offset = 0,
+				.done = 0,
+				.chain_left = 0,
+				.sampled = false,
+				.issue_ns = 0,
+			});
+		}
+		streams_.reserve(options_.streams);
+		for (size_t i = 0; i < options_.streams; ++i) {
+			// Streams get consecutive I/O regions as if they were jobs
+			size_t index = id * options_.streams + i;
+			Stream &stream = streams_.emplace_back(Stream{
+				.base_offset =
+					options_.offset + index * options_.offset_increment,
+				.next_block =
+					options_.sequencer.type == SequencerType::Reverse ?
+						options_.num_blocks - 1 : 0,
+				.run_remaining = 0,
+				.zoned_writer = std::nullopt,
+				.ops_left = options_.num_ops,
+				.next_ns = 0,
+			});
+			if (
+				options_.zone_mode != ZoneMode::None &&
+				options_.io_type == IOType::Write
+			) {
+				stream.zoned_writer.emplace(options_, fd_, stream.base_offset);
 			}
-		} else {
-			size_t num_op = options_.num_blocks;
-			while (num_op) {
-				num_op -= 1;
-				rw_one_block();
+			if (work_pool_ != nullptr) {
+				push_work(stream);
+			}
+		}
+	}
+	// Starts issuing I/Os at start, which may be in the future
+	void run(rusty::time::Instant start) {
+		std::optional<uint64_t> interval_ns;
+		if (options_.bandwidth.has_value()) {
+			interval_ns = options_.bs * 1e9 / options_.bandwidth.value();
+		}
+		for (Stream &stream : streams_) {
+			if (interval_ns.has_value() && streams_.size() > 1) {
+				// Spread the first ticks over one interval so that the
+				// streams do not issue in lockstep
+				stream.next_ns = bounded_rand(rng_(), interval_ns.value());
 			}
+			executor_.spawn(run_stream(stream, interval_ns));
 		}
+		executor_.run(start);
 		run_time_ += start.elapsed();
+		if (lat_log_) {
+			lat_log_->finish(executor_.now_ns());
+		}
 	}
 	void pwrite(size_t offset, size_t n) {
 		char *buf = aligned_buf_;
@@ -137,102 +936,1546 @@ public:
 			rusty_panic();
 		}
 	}
+	// Number of I/Os completed. Differs between workers if they steal work.
+	// An update of readmodifywrite counts as one.
+	size_t ops_done() const { return ops_done_; }
+	// Bytes read and written
+	size_t io_bytes() const { return io_bytes_; }
 	rusty::time::Duration io_time() const { return io_time_; }
+	const Histogram &latency() const { return latency_; }
 	rusty::time::Duration run_time() const { return run_time_; }
+	// Empty if not paced
+	const PacingStats &pacing() const { return pacing_; }
+	// Number of failed I/Os per errno. 0 means an unexpected end of file.
+	const std::map<int, size_t> &errors() const { return errors_; }
+	// Issue time of the first I/O, if any, in nanoseconds since the start
+	// time given to run()
+	const std::optional<uint64_t> &first_issue_ns() const {
+		return first_issue_ns_;
+	}
+	// Completion time of the last I/O, if any, in the same terms
+	const std::optional<uint64_t> &last_completion_ns() const {
+		return last_completion_ns_;
+	}
 
 private:
-	void rw_one_block() {
-		auto start = rusty::time::Instant::now();
-		switch (options_.io_type) {
-		case IOType::RandRead: {
-			char *buf = aligned_buf_;
-			size_t offset = block_dist(rng_) * options_.bs;
-			size_t n = options_.bs;
-			do {
-				ssize_t ret = pread(fd_, buf, n, offset);
-				if (ret == -1 || ret == 0) {
-					perror("pread");
-					rusty_panic();
+	// Splits the I/Os of the stream into chunks of consecutive blocks.
+	// Chunks do not wrap around the end of the I/O region.
+	void push_work(Stream &stream) {
+		size_t block = 0;
+		while (stream.ops_left) {
+			size_t n = std::min({
+				options_.work_chunk_ops, stream.ops_left,
+				options_.num_blocks - block
+			});
+			work_pool_->push(id_, WorkChunk{
+				.base_offset = stream.base_offset,
+				.first_block = block,
+				.num_ops = n,
+			});
+			stream.ops_left -= n;
+			block = (block + n) % options_.num_blocks;
+		}
+	}
+	bool take_work(Stream &stream) {
+		if (work_pool_ == nullptr) {
+			return false;
+		}
+		std::optional<WorkChunk> chunk = work_pool_->take(id_);
+		if (!chunk.has_value()) {
+			return false;
+		}
+		stream.base_offset = chunk.value().base_offset;
+		stream.next_block = chunk.value().first_block;
+		stream.ops_left = chunk.value().num_ops;
+		return true;
+	}
+	// Each pacing tick of a stream issues up to iodepth_batch_submit I/Os.
+	// The stream falls behind its ticks if it runs out of I/O slots.
+	Task run_stream(Stream &stream, std::optional<uint64_t> interval_ns) {
+		while (stream.ops_left || take_work(stream)) {
+			co_await executor_.sleep_until(stream.next_ns);
+			size_t n = std::min(options_.iodepth_batch_submit, stream.ops_left);
+			for (size_t i = 0; i < n; ++i) {
+				size_t slot = co_await executor_.acquire_slot();
+				if (interval_ns.has_value()) {
+					// Waiting for a free slot also delays the I/O
+					uint64_t now = executor_.now_ns();
+					uint64_t lag = now > stream.next_ns ? now - stream.next_ns : 0;
+					pacing_.record(lag, interval_ns.value());
+					metrics_.record_lag(lag, lag > LATE_THRESHOLD_NS);
 				}
-				assert(ret > 0);
-				buf += ret;
-				n -= ret;
-				offset += ret;
-			} while (n);
-		} break;
-		case IOType::Read: {
-			char *buf = aligned_buf_;
-			size_t n = options_.bs;
-			do {
-				ssize_t ret = read(fd_, buf, n);
-				if (ret == -1 || ret == 0) {
-					perror("read");
-					rusty_panic();
+				prep_io(slot, stream);
+				executor_.spawn(do_io(slot));
+			}
+			stream.ops_left -= n;
+			if (interval_ns.has_value()) {
+				stream.next_ns += interval_ns.value() * n;
+			}
+		}
+	}
+	Task do_io(size_t index) {
+		IOSlot &slot = slots_[index];
+		for (;;) {
+			const char *op_name = slot.op == IOOp::Read ? "pread" : "pwrite";
+			size_t retries = 0;
+			size_t eagains = 0;
+			uint64_t backoff_ns = options_.retry_backoff_ns;
+			bool ok = false;
+			for (;;) {
+				IOResult result = co_await executor_.io(IOUnit{
+					.op = slot.op,
+					.fd = fd_,
+					.buf = slot.buf + slot.done,
+					.len = slot.len - slot.done,
+					.offset = slot.offset + slot.done,
+					.user_data = 0,
+				});
+				if (result.res == -EINTR) {
+					continue;
 				}
-				assert(ret > 0);
-				buf += ret;
-				n -= ret;
-			} while (n);
-		} break;
-		case IOType::Write: {
-			char *buf = aligned_buf_;
-			size_t n = options_.bs;
-			do {
-				ssize_t ret = write(fd_, buf, n);
-				if (ret == -1 || ret == 0) {
-					perror("write");
-					rusty_panic();
+				if (result.res == -EAGAIN && eagains < MAX_EAGAIN) {
+					// Not a failure of the I/O unless it keeps happening,
+					// so it does not count as a retry
+					eagains += 1;
+					co_await executor_.sleep_until(
+						executor_.now_ns() + options_.retry_backoff_ns
+					);
+					continue;
 				}
-				assert(ret > 0);
-				buf += ret;
-				n -= ret;
-			} while (n);
-		} break;
+				if (result.res <= 0) {
+					// 0 is an unexpected end of file
+					int err = -result.res;
+					if (retries < options_.io_retries) {
+						retries += 1;
+						eagains = 0;
+						metrics_.record_retry();
+						co_await executor_.sleep_until(
+							executor_.now_ns() + backoff_ns
+						);
+						backoff_ns *= 2;
+						continue;
+					}
+					fail_io(slot.op, op_name, err);
+					break;
+				}
+				slot.done += result.res;
+				if (slot.done == slot.len) {
+					io_bytes_ += slot.len;
+					// An update of readmodifywrite completes with its write
+					if (
+						options_.io_type != IOType::ReadModifyWrite ||
+						slot.op == IOOp::Write
+					) {
+						complete_io(slot, result.time_ns);
+					}
+					ok = true;
+					break;
+				}
+				// Short read or write. Submit the rest.
+			}
+			// A failed I/O breaks its chain
+			if (!ok || !next_in_chain(slot)) {
+				break;
+			}
+			if (
+				options_.io_type == IOType::ReadAfterWrite &&
+				options_.raw_delay_ns
+			) {
+				co_await executor_.sleep_until(
+					executor_.now_ns() + options_.raw_delay_ns
+				);
+			}
+			slot.done = 0;
+			if (
+				slot.sampled &&
+				options_.io_type != IOType::ReadModifyWrite
+			) {
+				slot.issue_ns = executor_.now_ns();
+			}
 		}
-		io_time_ += start.elapsed();
+		executor_.release_slot(index);
 	}
-
-	const Options &options_;
-	int fd_;
-
-	std::mt19937_64 rng_;
-	std::vector<char> buf_;
-	char *aligned_buf_;
-	std::uniform_int_distribution<size_t> block_dist;
-	rusty::time::Duration io_time_;
-	rusty::time::Duration run_time_;
-};
-
-int main(int argc, char **argv) {
-	std::string arg_bs;
-	std::string filename;
-	size_t numjobs;
-	std::string readwrite;
-	std::string arg_size;
-
-	namespace po = boost::program_options;
-	po::options_description desc("Available options");
-	desc.add_options()("help", "Print help message");
-	desc.add_options()("bandwidth", po::value<std::string>());
-	desc.add_options()("bs", po::value<std::string>(&arg_bs)->required());
-	desc.add_options()(
-		"filename", po::value<std::string>(&filename)->required()
-	);
-	desc.add_options()(
-		"group_reporting",
-		"Display statistics for groups of jobs as a whole "
-			"instead of for each individual job"
-	);
-	desc.add_options()(
-		"numjobs", po::value<size_t>(&numjobs)->default_value(1)
-	);
-	desc.add_options()(
+	void complete_io(IOSlot &slot, uint64_t time_ns) {
+		ops_done_ += 1;
+		metrics_.record_io(options_.bs);
+		last_completion_ns_ = time_ns;
+		if (!slot.sampled) {
+			return;
+		}
+		uint64_t latency_ns = time_ns - slot.issue_ns;
+		io_time_ += rusty::time::Duration::from_nanos(latency_ns);
+		latency_.record(latency_ns);
+		metrics_.record_latency(latency_ns);
+		if (lat_log_) {
+			lat_log_->record(time_ns, latency_ns);
+		}
+	}
+	// Sampling each I/O with probability p is the same as leaving
+	// geometrically distributed runs of I/Os unsampled in between
+	size_t next_sample_skip() {
+		return std::geometric_distribution<size_t>(
+			1.0 / options_.lat_sampling
+		)(rng_);
+	}
+	bool sample_latency() {
+		if (options_.lat_sampling == 1) {
+			return true;
+		}
+		if (sample_skip_ > 0) {
+			sample_skip_ -= 1;
+			return false;
+		}
+		sample_skip_ = next_sample_skip();
+		return true;
+	}
+	// Sets up the next I/O of the chain of the slot, if any
+	bool next_in_chain(IOSlot &slot) {
+		switch (options_.io_type) {
+		case IOType::ReadAfterWrite:
+			if (slot.op == IOOp::Write) {
+				slot.op = IOOp::Read;
+				return true;
+			}
+			return false;
+		case IOType::ReadModifyWrite:
+			if (slot.op == IOOp::Read) {
+				memset(
+					slot.buf + (slot.update_offset - slot.offset), 0xa5,
+					options_.bs
+				);
+				slot.op = IOOp::Write;
+				return true;
+			}
+			return false;
+		case IOType::PointerChase: {
+			if (slot.chain_left == 0) {
+				return false;
+			}
+			slot.chain_left -= 1;
+			uint64_t word;
+			memcpy(&word, slot.buf, sizeof(word));
+			size_t block =
+				(slot.offset - slot.base_offset) / options_.block_align;
+			size_t next =
+				bounded_rand(mix64(word ^ block), num_random_blocks());
+			slot.offset = slot.base_offset + next * options_.block_align;
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+	std::unique_ptr<IOEngine> new_engine() {
+		auto engine = new_io_engine(options_.io_engine, options_.iodepth);
+		if (!options_.faults.has_value()) {
+			return engine;
+		}
+		return new_faulty_engine(
+			std::move(engine), options_.iodepth, options_.faults.value(), rng_()
+		);
+	}
+	// Counts the error if the I/O type may fail, aborts otherwise
+	void fail_io(IOOp op, const char *op_name, int err) {
+		if (!tolerates_error(options_.continue_on_error, op)) {
+			if (err == 0) {
+				rusty_panic("%s: unexpected end of file", op_name);
+			}
+			errno = err;
+			perror(op_name);
+			rusty_panic();
+		}
+		errors_[err] += 1;
+		num_errors_ += 1;
+		metrics_.record_error();
+		if (
+			options_.max_errors.has_value() &&
+			num_errors_ > options_.max_errors.value()
+		) {
+			rusty_panic(
+				"Job %zu: more than %zu I/O errors, the last one %s: %s", id_,
+				options_.max_errors.value(), op_name, error_name(err).c_str()
+			);
+		}
+	}
+	void prep_io(size_t index, Stream &stream) {
+		IOSlot &slot = slots_[index];
+		slot.len = options_.bs;
+		switch (options_.io_type) {
+		case IOType::RandRead:
+			slot.op = IOOp::Read;
+			slot.offset = random_offset(stream);
+			break;
+		case IOType::Read:
+			slot.op = IOOp::Read;
+			slot.offset = block_offset(stream, next_sequenced_block(stream));
+			break;
+		case IOType::Write:
+			slot.op = IOOp::Write;
+			if (stream.zoned_writer.has_value()) {
+				slot.offset = stream.zoned_writer->next_offset();
+			} else {
+				slot.offset =
+					block_offset(stream, next_sequenced_block(stream));
+			}
+			break;
+		case IOType::RandWrite:
+			slot.op = IOOp::Write;
+			slot.offset = random_offset(stream);
+			break;
+		case IOType::ReadAfterWrite:
+			slot.op = IOOp::Write;
+			slot.offset = block_offset(stream, next_sequenced_block(stream));
+			break;
+		case IOType::PointerChase:
+			slot.op = IOOp::Read;
+			slot.offset = random_offset(stream);
+			slot.chain_left = options_.chase_depth - 1;
+			break;
+		case IOType::ReadModifyWrite: {
+			size_t align = options_.rmw_align;
+			slot.op = IOOp::Read;
+			slot.update_offset = random_offset(stream);
+			slot.offset = slot.update_offset / align * align;
+			slot.len = (slot.update_offset + options_.bs + align - 1) /
+				align * align - slot.offset;
+		} break;
+		}
+		slot.base_offset = stream.base_offset;
+		slot.done = 0;
+		// Unsampled I/Os skip the clock read
+		slot.sampled = sample_latency();
+		if (slot.sampled || !first_issue_ns_.has_value()) {
+			slot.issue_ns = executor_.now_ns();
+		}
+		if (!first_issue_ns_.has_value()) {
+			first_issue_ns_ = slot.issue_ns;
+		}
+	}
+	// Room for the longest I/O, keeping the buffers of the slots aligned
+	size_t slot_buf_size() const {
+		if (options_.io_type != IOType::ReadModifyWrite) {
+			return options_.bs;
+		}
+		size_t align = options_.rmw_align;
+		size_t len = (options_.bs + align - 1) / align * align + align;
+		return (len + options_.blksize - 1) / options_.blksize *
+			options_.blksize;
+	}
+	// Fills the buffers with random data, so that writes do not store
+	// zeros, which a device may compress or skip
+	void fill_buf() {
+		uint64_t raw[BLOCK_RING_SIZE];
+		size_t len = options_.iodepth * slot_buf_size();
+		for (size_t pos = 0; pos < len; pos += sizeof(raw)) {
+			batch_rng_.fill(raw, BLOCK_RING_SIZE);
+			memcpy(aligned_buf_ + pos, raw, std::min(sizeof(raw), len - pos));
+		}
+	}
+	size_t block_offset(const Stream &stream, size_t block) const {
+		return stream.base_offset + block * options_.bs;
+	}
+	size_t random_offset(const Stream &stream) {
+		return stream.base_offset + random_block() * options_.block_align;
+	}
+	// Number of offsets on the block_align grid at which a whole I/O of
+	// bs fits into the I/O region
+	size_t num_random_blocks() const {
+		size_t last = (options_.num_blocks - 1) * options_.bs;
+		return last / options_.block_align + 1;
+	}
+	size_t random_block() {
+		if (ring_pos_ == BLOCK_RING_SIZE) {
+			refill_block_ring();
+		}
+		return block_ring_[ring_pos_++];
+	}
+	void refill_block_ring() {
+		if (!options_.zones.has_value()) {
+			uint64_t raw[BLOCK_RING_SIZE];
+			batch_rng_.fill(raw, BLOCK_RING_SIZE);
+			size_t num_blocks = num_random_blocks();
+			for (size_t i = 0; i < BLOCK_RING_SIZE; ++i) {
+				block_ring_[i] = bounded_rand(raw[i], num_blocks);
+			}
+		} else {
+			// One number picks the zone, the other the block in the zone
+			uint64_t raw[BLOCK_RING_SIZE * 2];
+			batch_rng_.fill(raw, BLOCK_RING_SIZE * 2);
+			const ZoneTable &table = options_.zones.value();
+			for (size_t i = 0; i < BLOCK_RING_SIZE; ++i) {
+				const Zone &zone = table.zones[
+					table.zone_of_pct[bounded_rand(raw[2 * i], 100)]
+				];
+				block_ring_[i] = zone.first_block +
+					bounded_rand(raw[2 * i + 1], zone.num_blocks);
+			}
+		}
+		ring_pos_ = 0;
+	}
+	size_t next_sequenced_block(Stream &stream) {
+		const Sequencer &seq = options_.sequencer;
+		size_t block = stream.next_block;
+		switch (seq.type) {
+		case SequencerType::Forward:
+			stream.next_block = (block + 1) % options_.num_blocks;
+			break;
+		case SequencerType::Stride:
+			stream.next_block =
+				(block + 1 + seq.stride_blocks) % options_.num_blocks;
+			break;
+		case SequencerType::Reverse:
+			stream.next_block =
+				block == 0 ? options_.num_blocks - 1 : block - 1;
+			break;
+		case SequencerType::Mixed:
+			if (stream.run_remaining == 0) {
+				block = random_block();
+				// Probability of starting a sequential run, chosen so that
+				// seq_pct percent of the I/Os are sequential.
+				double p = seq.seq_pct / 100;
+				double p_run = p / (seq.run_len * (1 - p) + p);
+				bool seq_run =
+					std::uniform_real_distribution<double>()(rng_) < p_run;
+				stream.run_remaining = seq_run ? seq.run_len : 1;
+			}
+			stream.run_remaining -= 1;
+			stream.next_block = (block + 1) % options_.num_blocks;
+			break;
+		}
+		return block;
+	}
+
+	const Options &options_;
+	size_t id_;
+	int fd_;
+	WorkPool *work_pool_;
+	JobMetrics &metrics_;
+
+	std::mt19937_64 rng_;
+	BatchRng batch_rng_;
+	std::array<size_t, BLOCK_RING_SIZE> block_ring_;
+	size_t ring_pos_;
+	// Number of I/Os to leave unsampled before the next sampled one
+	size_t sample_skip_;
+	std::vector<char> buf_;
+	char *aligned_buf_;
+	Executor executor_;
+	std::vector<IOSlot> slots_;
+	std::vector<Stream> streams_;
+	// Counters updated on every completion, apart from the state above
+	alignas(CACHE_LINE_SIZE) size_t ops_done_;
+	size_t io_bytes_;
+	rusty::time::Duration io_time_;
+	rusty::time::Duration run_time_;
+	std::optional<uint64_t> first_issue_ns_;
+	std::optional<uint64_t> last_completion_ns_;
+	Histogram latency_;
+	PacingStats pacing_;
+	std::map<int, size_t> errors_;
+	size_t num_errors_;
+	std::unique_ptr<LatencyLog> lat_log_;
+};
+
+static void print_errors(const std::map<int, size_t> &errors) {
+	for (const auto &[err, n] : errors) {
+		std::cout << "  " << n << " errors: " << error_name(err) << std::endl;
+	}
+}
+
+// Percentiles of sampled latencies with their 95% confidence intervals
+static void print_sampled_latency(
+	const Histogram &latency, size_t lat_sampling
+) {
+	std::cout << "  sampled latency (1 in " << lat_sampling << ", "
+		<< latency.count() << " samples)";
+	const std::pair<const char *, double> percentiles[] = {
+		{"p50", 0.5},
+		{"p99", 0.99},
+		{"p99.9", 0.999},
+	};
+	for (const auto &[name, fraction] : percentiles) {
+		auto [low, high] = latency.percentile_interval(fraction, Z_95);
+		std::cout << (fraction == 0.5 ? " " : ", ") << name << " "
+			<< latency.percentile(fraction) << "ns [" << low << ", " << high
+			<< "]";
+	}
+	std::cout << std::endl;
+}
+
+static void print_pacing(const PacingStats &pacing) {
+	uint64_t ops = pacing.lag.count();
+	std::cout << "  pacing lag p50 " << pacing.lag.percentile(0.5)
+		<< "ns, p99 " << pacing.lag.percentile(0.99) << "ns, max "
+		<< pacing.lag.max() << "ns, "
+		<< (ops ? 100.0 * pacing.late_ops / ops : 0) << "% of I/Os late, "
+		<< "behind schedule for " << pacing.behind_ns / 1e9 << "s"
+		<< std::endl;
+}
+
+// Warns if the job could not keep up with its requested rate
+static void warn_if_behind(size_t job, const PacingStats &pacing) {
+	uint64_t ops = pacing.lag.count();
+	if (pacing.last_lag_ns > LATE_THRESHOLD_NS) {
+		std::cerr << "WARNING: job " << job << " ended "
+			<< pacing.last_lag_ns / 1e6 << "ms behind schedule. The "
+			"requested rate is not achievable with these settings, so the "
+			"throughput above is lower than requested." << std::endl;
+	} else if (ops && pacing.late_ops > LATE_WARN_FRACTION * ops) {
+		std::cerr << "WARNING: job " << job << " was behind schedule for "
+			<< pacing.behind_ns / 1e9 << "s with "
+			<< 100.0 * pacing.late_ops / ops << "% of I/Os late. The "
+			"requested rate was not sustained throughout the run."
+			<< std::endl;
+	}
+}
+
+static int run_metadata(
+	const boost::program_options::variables_map &vm,
+	const std::string &dir, size_t numjobs, bool group_reporting,
+	std::mt19937_64 &rng
+) {
+	rusty_assert(
+		!vm.count("metrics_listen") && !vm.count("write_lat_log") &&
+			!vm.count("json_output") && vm["lat_sampling"].defaulted() &&
+			vm["clocksource"].defaulted() && !vm.count("sweep") &&
+			!vm.count("qos_sweep") && !vm.count("require_precondition"),
+		"metadata can not be used with metrics_listen, write_lat_log, "
+			"json_output, lat_sampling, clocksource, sweep, qos_sweep or "
+			"require_precondition"
+	);
+	std::string arg_mix = vm["metadata_mix"].as<std::string>();
+	auto mix = parse_metadata_mix(arg_mix);
+	rusty_assert(
+		mix.has_value(), "Invalid argument metadata_mix: %s", arg_mix.c_str()
+	);
+	MetadataOptions options{
+		.dir = dir,
+		.nrfiles = vm["nrfiles"].as<size_t>(),
+		.files_per_dir = vm["files_per_dir"].as<size_t>(),
+		.num_ops = vm["number_ios"].as<size_t>(),
+		.interval_ns = std::nullopt,
+		.mix = mix.value(),
+	};
+	rusty_assert(options.nrfiles >= 2, "nrfiles must be at least 2");
+	rusty_assert(options.num_ops > 0, "number_ios must be positive");
+	rusty_assert(options.files_per_dir > 0, "files_per_dir must be positive");
+	if (vm.count("rate_iops")) {
+		uint64_t rate = vm["rate_iops"].as<uint64_t>();
+		rusty_assert(rate > 0, "rate_iops must be positive");
+		options.interval_ns = 1000000000 / rate;
+	}
+
+	std::cout << "Creating files...";
+	std::cout.flush();
+	std::vector<MetadataWorker> workers;
+	workers.reserve(numjobs);
+	for (size_t i = 0; i < numjobs; ++i) {
+		workers.emplace_back(options, i, rng());
+	}
+	std::cout << " done" << std::endl;
+	std::optional<rusty::time::Instant> start;
+	std::barrier start_barrier(numjobs, [&start]() noexcept {
+		start = rusty::time::Instant::now() +
+			rusty::time::Duration::from_nanos(START_DELAY_NS);
+	});
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < numjobs; ++i) {
+		threads.emplace_back([&workers, &start_barrier, &start, i] {
+			start_barrier.arrive_and_wait();
+			workers[i].run(start.value());
+		});
+	}
+	for (size_t i = 0; i < numjobs; ++i) {
+		threads[i].join();
+	}
+
+	auto print_latency = [](const std::array<Histogram, NUM_METADATA_OPS> &h) {
+		for (size_t op = 0; op < NUM_METADATA_OPS; ++op) {
+			if (h[op].count() == 0) {
+				continue;
+			}
+			std::cout << "  " << metadata_op_name((MetadataOp)op) << ": "
+				<< h[op].count() << " ops, latency p50 "
+				<< h[op].percentile(0.5) << "ns, p99 " << h[op].percentile(0.99)
+				<< "ns, max " << h[op].max() << "ns" << std::endl;
+		}
+	};
+	if (numjobs > 1 && group_reporting) {
+		std::array<Histogram, NUM_METADATA_OPS> latency;
+		PacingStats pacing;
+		double run_time = 0;
+		for (const MetadataWorker &worker : workers) {
+			for (size_t op = 0; op < NUM_METADATA_OPS; ++op) {
+				latency[op].merge(worker.latency()[op]);
+			}
+			pacing.merge(worker.pacing());
+			run_time = std::max(run_time, worker.run_time().as_secs_double());
+		}
+		std::cout << "Throughput "
+			<< (run_time > 0 ? options.num_ops * numjobs / run_time : 0)
+			<< " ops/s" << std::endl;
+		print_latency(latency);
+		if (options.interval_ns.has_value()) {
+			print_pacing(pacing);
+		}
+	} else {
+		for (size_t i = 0; i < numjobs; ++i) {
+			if (numjobs > 1) {
+				std::cout << i << ": ";
+			}
+			double run_time = workers[i].run_time().as_secs_double();
+			std::cout << "throughput "
+				<< (run_time > 0 ? options.num_ops / run_time : 0)
+				<< " ops/s" << std::endl;
+			print_latency(workers[i].latency());
+			if (options.interval_ns.has_value()) {
+				print_pacing(workers[i].pacing());
+			}
+		}
+	}
+	if (options.interval_ns.has_value()) {
+		for (size_t i = 0; i < numjobs; ++i) {
+			warn_if_behind(i, workers[i].pacing());
+		}
+	}
+	return 0;
+}
+
+static double cpu_seconds() {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == -1) {
+		perror("getrusage");
+		rusty_panic();
+	}
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+		usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Writes the first file_size bytes of fd sequentially in large blocks
+static void fill_file(
+	int fd, size_t file_size, IOEngineType io_engine, size_t iodepth,
+	std::mt19937_64 &rng
+) {
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) == -1) {
+		perror("fstat");
+		rusty_panic();
+	}
+	size_t write_bs = std::min(file_size, (size_t)1 << 20);
+	JobMetrics prefill_metrics;
+	size_t remain = file_size % write_bs;
+	Worker worker(
+		Options{
+			.blksize = static_cast<size_t>(file_stat.st_blksize),
+			.bandwidth = std::nullopt,
+			.bs = write_bs,
+			.block_align = write_bs,
+			.io_type = IOType::Write,
+			.num_blocks = file_size / write_bs,
+			.num_ops = file_size / write_bs,
+			.streams = 1,
+			.sequencer = Sequencer{
+				.type = SequencerType::Forward,
+				.stride_blocks = 0,
+				.seq_pct = 0,
+				.run_len = 0,
+			},
+			.offset = 0,
+			.offset_increment = 0,
+			.zones = std::nullopt,
+			.zone_mode = ZoneMode::None,
+			.zone_size = 0,
+			.max_open_zones = 0,
+			.io_engine = io_engine,
+			.iodepth = iodepth,
+			.iodepth_batch_submit = 1,
+			.iodepth_batch_complete_min = 1,
+			.iodepth_batch_complete_max = iodepth,
+			.work_chunk_ops = 0,
+			.lat_log = std::nullopt,
+			.lat_log_window_ns = 0,
+			.lat_sampling = 1,
+			.continue_on_error = ContinueOnError::None,
+			.io_retries = 0,
+			.retry_backoff_ns = 0,
+			.max_errors = std::nullopt,
+			.faults = std::nullopt,
+			.raw_delay_ns = 0,
+			.chase_depth = 0,
+			.rmw_align = 0,
+		},
+		0, fd, rng(), nullptr, prefill_metrics
+	);
+	worker.run(rusty::time::Instant::now());
+	if (remain != 0) {
+		worker.pwrite(file_size - remain, remain);
+	}
+}
+
+// Opens the file with flags. Writes it first if it is smaller than
+// file_size.
+static int open_prefilled(
+	const std::string &filename, size_t file_size, int flags,
+	std::mt19937_64 &rng
+) {
+	for (;;) {
+		int fd = open(filename.c_str(), flags);
+		if (fd == -1) {
+			if (errno != ENOENT) {
+				perror("open");
+				rusty_panic();
+			}
+			std::cout << "Target file does not exists, writing...";
+		} else {
+			rusty_assert(fd >= 0);
+			struct stat file_stat;
+			if (fstat(fd, &file_stat) == -1) {
+				perror("fstat");
+				rusty_panic();
+			}
+			if (file_stat.st_size >= file_size) {
+				return fd;
+			}
+			close(fd);
+			std::cout << "Target file too small, rewriting...";
+		}
+		std::cout.flush();
+		fd = open(
+			filename.c_str(),
+			(flags & O_DIRECT) | O_WRONLY | O_CREAT | O_TRUNC,
+			S_IRUSR | S_IWUSR
+		);
+		if (fd == -1) {
+			perror("open");
+			rusty_panic();
+		}
+		fill_file(fd, file_size, IOEngineType::Sync, 1, rng);
+		rusty_assert(close(fd) == 0);
+		std::cout << " done" << std::endl;
+	}
+}
+
+// Runs numjobs jobs over fd and prints their results
+static RunResult run_jobs(
+	const Options &options, size_t numjobs, int fd, bool group_reporting,
+	bool work_stealing, const std::optional<std::string> &metrics_listen,
+	std::mt19937_64 &rng
+) {
+	std::optional<WorkPool> work_pool;
+	if (work_stealing) {
+		work_pool.emplace(numjobs);
+	}
+	std::vector<Worker> workers;
+	workers.reserve(numjobs);
+	std::vector<JobMetrics> metrics(numjobs);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < numjobs; ++i) {
+		workers.emplace_back(
+			options, i, fd, rng(),
+			work_pool.has_value() ? &work_pool.value() : nullptr, metrics[i]
+		);
+	}
+	std::optional<MetricsServer> metrics_server;
+	if (metrics_listen.has_value()) {
+		metrics_server.emplace(metrics_listen.value(), metrics);
+	}
+	// Spawning hundreds of threads takes a while. Once all of them are
+	// ready, the last one to arrive picks a start time a bit in the future,
+	// so that every job has been scheduled again when it comes.
+	std::optional<rusty::time::Instant> start;
+	std::barrier start_barrier(numjobs, [&start]() noexcept {
+		start = rusty::time::Instant::now() +
+			rusty::time::Duration::from_nanos(START_DELAY_NS);
+	});
+	double cpu_start = cpu_seconds();
+	for (size_t i = 0; i < numjobs; ++i) {
+		threads.emplace_back([&workers, &start_barrier, &start, i] {
+			start_barrier.arrive_and_wait();
+			workers[i].run(start.value());
+		});
+	}
+	for (size_t i = 0; i < numjobs; ++i) {
+		threads[i].join();
+	}
+	double cpu_time = cpu_seconds() - cpu_start;
+	// The group runs from the first I/O issued to the last one completed.
+	// The times of the workers compare as they share their start time.
+	std::optional<uint64_t> first_issue_ns;
+	std::optional<uint64_t> last_completion_ns;
+	for (const Worker &worker : workers) {
+		const auto &issue = worker.first_issue_ns();
+		if (issue.has_value()) {
+			first_issue_ns = std::min(
+				first_issue_ns.value_or(UINT64_MAX), issue.value()
+			);
+		}
+		const auto &completion = worker.last_completion_ns();
+		if (completion.has_value()) {
+			last_completion_ns = std::max(
+				last_completion_ns.value_or(0), completion.value()
+			);
+		}
+	}
+	auto run_time = rusty::time::Duration::from_nanos(0);
+	if (first_issue_ns.has_value() && last_completion_ns.has_value()) {
+		run_time = rusty::time::Duration::from_nanos(
+			last_completion_ns.value() - first_issue_ns.value()
+		);
+	}
+	// With work stealing, jobs do different numbers of I/Os
+	if (numjobs > 1 && group_reporting) {
+		auto io_time = rusty::time::Duration::from_nanos(0);
+		size_t ops = 0;
+		Histogram latency;
+		PacingStats pacing;
+		std::map<int, size_t> errors;
+		for (size_t i = 0; i < numjobs; ++i) {
+			io_time += workers[i].io_time();
+			ops += workers[i].ops_done();
+			latency.merge(workers[i].latency());
+			pacing.merge(workers[i].pacing());
+			for (const auto &[err, n] : workers[i].errors()) {
+				errors[err] += n;
+			}
+		}
+		size_t sampled = latency.count();
+		// Without any completed I/O the group has no run time
+		double secs = run_time.as_secs_double();
+		std::cout << "Throughput "
+			<< (secs > 0 ? ops * options.bs / secs / 1e6 : 0)
+			<< "MB/s, avg latency "
+			<< (sampled ? io_time.as_nanos() / sampled : 0) << "ns"
+			<< std::endl;
+		if (options.lat_sampling > 1) {
+			print_sampled_latency(latency, options.lat_sampling);
+		}
+		if (options.bandwidth.has_value()) {
+			print_pacing(pacing);
+		}
+		print_errors(errors);
+	} else {
+		for (size_t i = 0; i < numjobs; ++i) {
+			if (numjobs > 1) {
+				std::cout << i << ": ";
+			}
+			size_t ops = workers[i].ops_done();
+			size_t sampled = workers[i].latency().count();
+			double run_time = workers[i].run_time().as_secs_double();
+			std::cout << "throughput " << ops * options.bs / run_time / 1e6
+				<< "MB/s, avg latency "
+				<< (sampled ? workers[i].io_time().as_nanos() / sampled : 0)
+				<< "ns";
+			if (work_pool.has_value()) {
+				std::cout << ", " << ops << " ops";
+			}
+			std::cout << std::endl;
+			if (options.lat_sampling > 1) {
+				print_sampled_latency(
+					workers[i].latency(), options.lat_sampling
+				);
+			}
+			if (options.bandwidth.has_value()) {
+				print_pacing(workers[i].pacing());
+			}
+			print_errors(workers[i].errors());
+		}
+	}
+	if (options.io_type == IOType::ReadModifyWrite) {
+		size_t ops = 0;
+		size_t io_bytes = 0;
+		for (const Worker &worker : workers) {
+			ops += worker.ops_done();
+			io_bytes += worker.io_bytes();
+		}
+		if (ops) {
+			std::cout << "Read-modify-write moved "
+				<< (double)io_bytes / (ops * options.bs)
+				<< " bytes per updated byte" << std::endl;
+		}
+	}
+	if (options.bandwidth.has_value()) {
+		for (size_t i = 0; i < numjobs; ++i) {
+			warn_if_behind(i, workers[i].pacing());
+		}
+	}
+	RunResult result{
+		.command = "",
+		.ops = 0,
+		.bytes = 0,
+		.run_time_s = run_time.as_secs_double(),
+		.cpu_s = cpu_time,
+		.latency_sum_ns = 0,
+		.latency = Histogram(),
+	};
+	for (const Worker &worker : workers) {
+		result.ops += worker.ops_done();
+		result.latency_sum_ns += worker.io_time().as_nanos();
+		result.latency.merge(worker.latency());
+	}
+	result.bytes = result.ops * options.bs;
+	return result;
+}
+
+// Fills the file sequentially twice, then writes random blocks in rounds
+// until the IOPS of the rounds reach a steady state or max_rounds rounds
+// are done. Records the outcome to state_path.
+static void run_precondition(
+	const Options &options, size_t numjobs, int fd, size_t file_size,
+	size_t max_rounds, const std::string &state_path,
+	const std::optional<std::string> &metrics_listen, std::mt19937_64 &rng
+) {
+	for (size_t pass = 1; pass <= 2; ++pass) {
+		std::cout << "Sequential fill " << pass << "/2...";
+		std::cout.flush();
+		auto start = rusty::time::Instant::now();
+		fill_file(fd, file_size, options.io_engine, options.iodepth, rng);
+		std::cout << " done, "
+			<< file_size / start.elapsed().as_secs_double() / 1e6 << "MB/s"
+			<< std::endl;
+	}
+	std::vector<double> iops;
+	bool steady_state = false;
+	while (!steady_state && iops.size() < max_rounds) {
+		std::cout << "Round " << iops.size() + 1 << ": ";
+		RunResult result = run_jobs(
+			options, numjobs, fd, true, false, metrics_listen, rng
+		);
+		iops.push_back(result.ops / result.run_time_s);
+		steady_state = is_steady_state(iops, STEADY_STATE_WINDOW);
+		std::cout << "  " << iops.back() << " IOPS"
+			<< (steady_state ? ", steady state" : "") << std::endl;
+	}
+	if (!steady_state) {
+		std::cerr << "WARNING: no steady state after " << max_rounds
+			<< " rounds" << std::endl;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) == -1) {
+		perror("fstat");
+		rusty_panic();
+	}
+	size_t window = std::min(iops.size(), STEADY_STATE_WINDOW);
+	double window_iops = 0;
+	for (size_t i = iops.size() - window; i < iops.size(); ++i) {
+		window_iops += iops[i] / window;
+	}
+	write_precondition_state(state_path, PreconditionState{
+		.dev = file_stat.st_dev,
+		.ino = file_stat.st_ino,
+		.size = file_size,
+		.bs = options.bs,
+		.iodepth = options.iodepth,
+		.numjobs = numjobs,
+		.rounds = iops.size(),
+		.steady_state = steady_state,
+		.iops = window_iops,
+		.time = time(nullptr),
+	});
+	std::cout << "State recorded in " << state_path << std::endl;
+}
+
+// Panics unless the state file shows that the first file_size bytes of
+// the file were preconditioned to a steady state
+static void check_precondition(
+	const std::string &filename, size_t file_size,
+	const std::string &state_path
+) {
+	struct stat file_stat;
+	if (stat(filename.c_str(), &file_stat) == -1) {
+		perror("stat");
+		rusty_panic("Failed to stat %s", filename.c_str());
+	}
+	PreconditionState state = read_precondition_state(state_path);
+	rusty_assert(
+		state.dev == file_stat.st_dev && state.ino == file_stat.st_ino,
+		"%s is not the state of %s", state_path.c_str(), filename.c_str()
+	);
+	rusty_assert(
+		state.steady_state, "%s was not preconditioned to a steady state",
+		filename.c_str()
+	);
+	rusty_assert(
+		state.size >= file_size,
+		"Only %zu bytes of %s are preconditioned, %zu needed",
+		(size_t)state.size, filename.c_str(), file_size
+	);
+	rusty_assert(
+		!S_ISREG(file_stat.st_mode) ||
+			(uint64_t)file_stat.st_size >= state.size,
+		"%s was truncated after preconditioning", filename.c_str()
+	);
+}
+
+// Rates of --qos_sweep in bytes per second per stream, from min up in
+// steps of step
+struct QosSweep {
+	size_t min;
+	size_t step;
+	std::optional<size_t> max;
+	uint64_t p99_threshold_ns;
+	size_t max_rounds;
+};
+
+// Number of the last rounds of a rate whose p99 has to agree
+constexpr size_t QOS_WINDOW = 3;
+// The device limit is reached once the throughput falls this far short
+// of the rate
+constexpr double QOS_ACHIEVED_MIN = 0.9;
+
+// min:step[:max], each as in bandwidth
+static std::optional<QosSweep> parse_qos_sweep(const std::string &s) {
+	std::vector<size_t> rates;
+	size_t begin = 0;
+	for (;;) {
+		size_t colon = s.find(':', begin);
+		auto rate = parse_bandwidth(s.substr(begin, colon - begin));
+		if (!rate.has_value() || rate.value() == 0) {
+			return std::nullopt;
+		}
+		rates.push_back(rate.value());
+		if (colon == std::string::npos) {
+			break;
+		}
+		begin = colon + 1;
+	}
+	if (rates.size() < 2 || rates.size() > 3) {
+		return std::nullopt;
+	}
+	QosSweep qos{
+		.min = rates[0],
+		.step = rates[1],
+		.max = std::nullopt,
+		.p99_threshold_ns = 0,
+		.max_rounds = 0,
+	};
+	if (rates.size() == 3) {
+		if (rates[2] < rates[0]) {
+			return std::nullopt;
+		}
+		qos.max = rates[2];
+	}
+	return qos;
+}
+
+// Steps the rate up until the device can not keep up with it, or up to
+// qos.max. Each rate is held for rounds of num_ops I/Os per stream until
+// the p99 latency of the last QOS_WINDOW rounds is steady, and the
+// rounds of the window make up the point of the rate. Prints the curve
+// and the knee, the first rate whose p99 exceeds the threshold.
+static std::vector<SweepPoint> run_qos_sweep(
+	const Options &options, size_t numjobs, int fd, bool group_reporting,
+	const std::optional<std::string> &metrics_listen, const QosSweep &qos,
+	std::mt19937_64 &rng
+) {
+	std::vector<SweepPoint> points;
+	for (
+		size_t rate = qos.min;
+		!qos.max.has_value() || rate <= qos.max.value();
+		rate += qos.step
+	) {
+		Options point = options;
+		point.bandwidth = rate;
+		std::vector<RunResult> rounds;
+		std::vector<double> p99;
+		while (
+			rounds.size() < qos.max_rounds &&
+			!is_steady_state(p99, QOS_WINDOW)
+		) {
+			std::cout << "== bandwidth=" << rate << "B/s round "
+				<< rounds.size() + 1 << std::endl;
+			rounds.push_back(run_jobs(
+				point, numjobs, fd, group_reporting, false, metrics_listen,
+				rng
+			));
+			p99.push_back(rounds.back().latency.percentile(0.99));
+		}
+		if (!is_steady_state(p99, QOS_WINDOW)) {
+			std::cerr << "WARNING: p99 latency not steady at " << rate
+				<< "B/s after " << rounds.size() << " rounds" << std::endl;
+		}
+		RunResult result{
+			.command = "",
+			.ops = 0,
+			.bytes = 0,
+			.run_time_s = 0,
+			.cpu_s = 0,
+			.latency_sum_ns = 0,
+			.latency = Histogram(),
+		};
+		size_t window = std::min(rounds.size(), QOS_WINDOW);
+		for (size_t i = rounds.size() - window; i < rounds.size(); ++i) {
+			result.ops += rounds[i].ops;
+			result.bytes += rounds[i].bytes;
+			result.run_time_s += rounds[i].run_time_s;
+			result.cpu_s += rounds[i].cpu_s;
+			result.latency_sum_ns += rounds[i].latency_sum_ns;
+			result.latency.merge(rounds[i].latency);
+		}
+		points.push_back(SweepPoint{
+			.readwrite = io_type_name(options.io_type),
+			.bs = options.bs,
+			.bandwidth = rate,
+			.numjobs = numjobs,
+			.iodepth = options.iodepth,
+			.result = std::move(result),
+		});
+		const RunResult &r = points.back().result;
+		double requested = (double)rate * numjobs * options.streams;
+		if (r.bytes / r.run_time_s < QOS_ACHIEVED_MIN * requested) {
+			break;
+		}
+	}
+
+	printf(
+		"%14s %14s %12s %12s %12s\n", "rate MB/s", "achieved MB/s",
+		"p50 us", "p99 us", "p99.9 us"
+	);
+	std::optional<size_t> knee;
+	for (size_t i = 0; i < points.size(); ++i) {
+		const RunResult &r = points[i].result;
+		const Histogram &h = r.latency;
+		printf(
+			"%14.3f %14.3f %12.1f %12.1f %12.1f\n",
+			points[i].bandwidth.value() * numjobs * options.streams / 1e6,
+			r.bytes / r.run_time_s / 1e6, h.percentile(0.5) / 1e3,
+			h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3
+		);
+		if (!knee.has_value() && h.percentile(0.99) > qos.p99_threshold_ns) {
+			knee = i;
+		}
+	}
+	if (!knee.has_value()) {
+		printf(
+			"No knee: p99 stays within %gus\n", qos.p99_threshold_ns / 1e3
+		);
+	} else if (knee.value() == 0) {
+		printf(
+			"Knee: p99 exceeds %gus already at the lowest rate\n",
+			qos.p99_threshold_ns / 1e3
+		);
+	} else {
+		printf(
+			"Knee: p99 exceeds %gus at %.3fMB/s, the last rate within it "
+				"is %.3fMB/s\n",
+			qos.p99_threshold_ns / 1e3,
+			points[knee.value()].bandwidth.value() * numjobs *
+				options.streams / 1e6,
+			points[knee.value() - 1].bandwidth.value() * numjobs *
+				options.streams / 1e6
+		);
+	}
+	return points;
+}
+
+static int run_small_files(
+	const boost::program_options::variables_map &vm,
+	const std::string &dir, bool write, size_t numjobs, bool group_reporting,
+	std::optional<size_t> bandwidth, IOEngineType io_engine,
+	const std::optional<FaultConfig> &faults, size_t iodepth,
+	ContinueOnError continue_on_error, std::optional<size_t> max_errors,
+	std::mt19937_64 &rng
+) {
+	rusty_assert(
+		!vm.count("metrics_listen") && !vm.count("write_lat_log") &&
+			!vm.count("json_output") && vm["lat_sampling"].defaulted() &&
+			!vm.count("sweep") && !vm.count("qos_sweep") &&
+			!vm.count("require_precondition"),
+		"fileread and filewrite can not be used with metrics_listen, "
+			"write_lat_log, json_output, lat_sampling, sweep, qos_sweep or "
+			"require_precondition"
+	);
+	std::string arg_file_size = vm["file_size"].as<std::string>();
+	auto file_size = parse_file_size_distribution(arg_file_size);
+	rusty_assert(
+		file_size.has_value(), "Invalid argument file_size: %s",
+		arg_file_size.c_str()
+	);
+	SmallFileOptions options{
+		.dir = dir,
+		.write = write,
+		.nrfiles = vm["nrfiles"].as<size_t>(),
+		.files_per_dir = vm["files_per_dir"].as<size_t>(),
+		.num_ops = vm["number_ios"].as<size_t>(),
+		.file_size = file_size.value(),
+		.bandwidth = bandwidth,
+		.link = vm.count("link_open_read_close") > 0,
+		.io_engine = io_engine,
+		.faults = faults,
+		.iodepth = iodepth,
+		.continue_on_error = continue_on_error,
+		.io_retries = vm["io_retries"].as<size_t>(),
+		.retry_backoff_ns = vm["retry_backoff_usec"].as<uint64_t>() * 1000,
+		.max_errors = max_errors,
+	};
+	rusty_assert(options.nrfiles > 0, "nrfiles must be positive");
+	rusty_assert(options.files_per_dir > 0, "files_per_dir must be positive");
+
+	std::cout << "Creating files...";
+	std::cout.flush();
+	std::vector<SmallFileWorker> workers;
+	workers.reserve(numjobs);
+	for (size_t i = 0; i < numjobs; ++i) {
+		workers.emplace_back(options, i, rng());
+	}
+	std::cout << " done" << std::endl;
+	std::optional<rusty::time::Instant> start;
+	std::barrier start_barrier(numjobs, [&start]() noexcept {
+		start = rusty::time::Instant::now() +
+			rusty::time::Duration::from_nanos(START_DELAY_NS);
+	});
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < numjobs; ++i) {
+		threads.emplace_back([&workers, &start_barrier, &start, i] {
+			start_barrier.arrive_and_wait();
+			workers[i].run(start.value());
+		});
+	}
+	for (size_t i = 0; i < numjobs; ++i) {
+		threads[i].join();
+	}
+
+	auto print_result = [](
+		size_t bytes, size_t files, double run_time, const Histogram &latency
+	) {
+		std::cout << "throughput " << bytes / run_time / 1e6 << "MB/s, "
+			<< files / run_time << " files/s" << std::endl;
+		std::cout << "  latency p50 " << latency.percentile(0.5) << "ns, p99 "
+			<< latency.percentile(0.99) << "ns, max " << latency.max() << "ns"
+			<< std::endl;
+	};
+	if (numjobs > 1 && group_reporting) {
+		Histogram latency;
+		PacingStats pacing;
+		std::map<int, size_t> errors;
+		size_t bytes = 0;
+		double run_time = 0;
+		for (const SmallFileWorker &worker : workers) {
+			latency.merge(worker.latency());
+			pacing.merge(worker.pacing());
+			for (const auto &[err, n] : worker.errors()) {
+				errors[err] += n;
+			}
+			bytes += worker.bytes();
+			run_time = std::max(run_time, worker.run_time().as_secs_double());
+		}
+		std::cout << "Group ";
+		print_result(bytes, options.num_ops * numjobs, run_time, latency);
+		if (bandwidth.has_value()) {
+			print_pacing(pacing);
+		}
+		print_errors(errors);
+	} else {
+		for (size_t i = 0; i < numjobs; ++i) {
+			if (numjobs > 1) {
+				std::cout << i << ": ";
+			}
+			print_result(
+				workers[i].bytes(), options.num_ops,
+				workers[i].run_time().as_secs_double(), workers[i].latency()
+			);
+			if (bandwidth.has_value()) {
+				print_pacing(workers[i].pacing());
+			}
+			print_errors(workers[i].errors());
+		}
+	}
+	if (bandwidth.has_value()) {
+		for (size_t i = 0; i < numjobs; ++i) {
+			warn_if_behind(i, workers[i].pacing());
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc >= 2 && strcmp(argv[1], "compare") == 0) {
+		return run_compare(argc - 1, argv + 1);
+	}
+	std::string arg_bs;
+	std::string filename;
+	size_t numjobs;
+	size_t streams;
+	std::string readwrite;
+	std::string arg_size;
+
+	namespace po = boost::program_options;
+	po::options_description desc("Available options");
+	desc.add_options()("help", "Print help message");
+	desc.add_options()("bandwidth", po::value<std::string>());
+	desc.add_options()(
+		"blockalign", po::value<std::string>(),
+		"Random I/Os start at multiples of this in the I/O region. "
+			"Defaults to bs"
+	);
+	desc.add_options()(
+		"bs", po::value<std::string>(&arg_bs),
+		"Block size. Required except in metadata and file mode"
+	);
+	desc.add_options()(
+		"buffered",
+		"Do buffered I/O instead of O_DIRECT, so that bs, blockalign, "
+			"offset, offset_increment and io_size need no alignment"
+	);
+	desc.add_options()(
+		"chase_depth", po::value<size_t>()->default_value(4),
+		"Number of dependent reads per chain of pointerchase"
+	);
+	desc.add_options()(
+		"clocksource", po::value<std::string>()->default_value("clock_gettime"),
+		"clock_gettime/tsc. tsc timestamps I/Os with the TSC calibrated "
+			"against CLOCK_MONOTONIC, and falls back to clock_gettime "
+			"if the CPU has no invariant TSC"
+	);
+	desc.add_options()(
+		"continue_on_error", po::value<std::string>()->default_value("none"),
+		"none/read/write/all. Failed I/Os of these types are counted and "
+			"reported instead of aborting the run"
+	);
+	desc.add_options()(
+		"fault_errno", po::value<int>()->default_value(EIO),
+		"errno of the I/Os failed by the faulty engine"
+	);
+	desc.add_options()(
+		"fault_error_rate", po::value<double>()->default_value(0),
+		"Fraction of I/Os failed by the faulty engine"
+	);
+	desc.add_options()(
+		"fault_latency", po::value<std::string>()->default_value("none"),
+		"Latency added by the faulty engine: none/fixed:usec/"
+			"uniform:min_usec:max_usec/exp:mean_usec/"
+			"lognormal:median_usec:sigma"
+	);
+	desc.add_options()(
+		"fault_stall", po::value<std::string>(),
+		"period_ms:stall_ms. The faulty engine completes nothing during "
+			"the first stall_ms of every period_ms"
+	);
+	desc.add_options()(
+		"faulty_ioengine", po::value<std::string>()->default_value("sync"),
+		"Engine wrapped by the faulty engine: sync/io_uring"
+	);
+	desc.add_options()(
+		"filename", po::value<std::string>(&filename)->required(),
+		"Target file, or directory in metadata and file mode"
+	);
+	desc.add_options()(
+		"file_size", po::value<std::string>()->default_value("fixed:4K"),
+		"Sizes of the files of fileread/filewrite: fixed:size/"
+			"uniform:min:max/lognormal:median:sigma:max"
+	);
+	desc.add_options()(
+		"files_per_dir", po::value<size_t>()->default_value(1000),
+		"Number of files per directory in metadata and file mode"
+	);
+	desc.add_options()(
+		"group_reporting",
+		"Display statistics for groups of jobs as a whole "
+			"instead of for each individual job"
+	);
+	desc.add_options()(
+		"iodepth", po::value<size_t>()->default_value(1),
+		"Number of I/Os in flight per job"
+	);
+	desc.add_options()(
+		"iodepth_batch_complete_max", po::value<size_t>(),
+		"Maximum number of I/Os to reap at once. Defaults to iodepth"
+	);
+	desc.add_options()(
+		"iodepth_batch_complete_min", po::value<size_t>()->default_value(1),
+		"Minimum number of I/Os to wait for when reaping"
+	);
+	desc.add_options()(
+		"iodepth_batch_submit", po::value<size_t>()->default_value(1),
+		"Number of I/Os to submit together at each pacing tick"
+	);
+	desc.add_options()(
+		"ioengine", po::value<std::string>()->default_value("sync"),
+		"sync/io_uring/faulty"
+	);
+	desc.add_options()(
+		"io_size", po::value<std::string>(),
+		"Amount of I/O per job, rounded up to whole I/Os. Defaults to size"
+	);
+	desc.add_options()(
+		"io_retries", po::value<size_t>()->default_value(0),
+		"Number of times a failed I/O is retried"
+	);
+	desc.add_options()(
+		"json_output", po::value<std::string>(),
+		"Write the result of the run as a whole to this JSON file, for "
+			"the compare subcommand, or the results of all points of a "
+			"sweep or qos_sweep. Not written in metadata and file mode"
+	);
+	desc.add_options()(
+		"lat_sampling", po::value<std::string>()->default_value("1/1"),
+		"1/N. Records the latency of each I/O with probability 1/N, so "
+			"that unsampled I/Os skip the clock read and the histograms. "
+			"Counts of I/Os and bytes stay exact, and percentiles are "
+			"printed with 95% confidence intervals"
+	);
+	desc.add_options()(
+		"link_open_read_close",
+		"Submit the open, read or write, and close of a file in "
+			"fileread/filewrite as one linked chain"
+	);
+	desc.add_options()(
+		"log_hist_msec", po::value<uint64_t>()->default_value(1000),
+		"Window of the histograms in the latency log in milliseconds"
+	);
+	desc.add_options()(
+		"max_open_zones", po::value<size_t>()->default_value(1),
+		"Number of zones written concurrently in zoned mode"
+	);
+	desc.add_options()(
+		"max_errors", po::value<size_t>(),
+		"Abort once a job has more failed I/Os than this with "
+			"continue_on_error. Unlimited by default"
+	);
+	desc.add_options()(
+		"metadata_mix", po::value<std::string>()->default_value(
+			"create:15,open:20,stat:40,fsync_dir:5,rename:5,unlink:15"
+		),
+		"Weights of the ops in metadata mode: op:weight,... with op in "
+			"create/open/stat/fsync_dir/rename/unlink"
+	);
+	desc.add_options()(
+		"metrics_listen", po::value<std::string>(),
+		"Serve Prometheus metrics over HTTP on [address:]port (loopback by "
+			"default) or unix:path"
+	);
+	desc.add_options()(
+		"nrfiles", po::value<size_t>()->default_value(1000),
+		"Number of file names per job in metadata and file mode. In "
+			"metadata mode half of them exist at the start"
+	);
+	desc.add_options()(
+		"number_ios", po::value<size_t>()->default_value(10000),
+		"Number of ops per job in metadata mode, or files per job in file "
+			"mode"
+	);
+	desc.add_options()(
+		"numjobs", po::value<size_t>(&numjobs)->default_value(1)
+	);
+	desc.add_options()(
+		"offset", po::value<std::string>(),
+		"Start offset of the I/O region in the file"
+	);
+	desc.add_options()(
+		"offset_increment", po::value<std::string>(),
+		"The I/O region of job i starts at offset + i * offset_increment"
+	);
+	desc.add_options()(
+		"precondition_rounds", po::value<size_t>()->default_value(25),
+		"Maximum number of rounds of random writes in precondition mode. "
+			"Each round writes io_size per job"
+	);
+	desc.add_options()(
+		"precondition_state", po::value<std::string>(),
+		"State file written by precondition mode and checked by "
+			"require_precondition. Defaults to <filename>.precondition"
+	);
+	desc.add_options()(
+		"qos_max_rounds", po::value<size_t>()->default_value(10),
+		"Maximum number of rounds per rate of qos_sweep"
+	);
+	desc.add_options()(
+		"qos_p99_usec", po::value<uint64_t>()->default_value(1000),
+		"p99 latency that marks the knee of qos_sweep"
+	);
+	desc.add_options()(
+		"qos_sweep", po::value<std::string>(),
+		"min:step[:max], with rates as in bandwidth. Steps bandwidth up "
+			"from min until the device can not keep up or max is passed. "
+			"Each rate is held for rounds of io_size per job until the "
+			"p99 latency is steady. Prints the latency curve and its knee"
+	);
+	desc.add_options()(
+		"raw_delay_usec", po::value<uint64_t>()->default_value(0),
+		"Delay between a write and the read of the block in readafterwrite"
+	);
+	desc.add_options()(
 		"readwrite", po::value<std::string>(&readwrite)->required(),
-		"randread/read/write"
+		"randread/read/write/randwrite/readafterwrite/pointerchase/"
+			"readmodifywrite/metadata/fileread/filewrite/precondition. "
+			"readafterwrite "
+			"reads back every block after writing it. pointerchase does "
+			"chains of reads, each at a block derived from the data of the "
+			"previous one. bandwidth and io_size count the first I/O of "
+			"each chain. fileread/filewrite read or write whole files of "
+			"a directory. precondition fills the file sequentially twice, "
+			"then writes random blocks until the IOPS are steady. "
+			"readmodifywrite updates bs bytes at random blocks by reading "
+			"the rmw_align units around them and writing them back"
+	);
+	desc.add_options()("randseed", po::value<seed_t>());
+	desc.add_options()(
+		"rate_iops", po::value<uint64_t>(),
+		"Number of ops per second per job in metadata mode"
+	);
+	desc.add_options()(
+		"require_precondition",
+		"Abort unless the precondition state file shows that the file "
+			"reached a steady state and has not been truncated since. "
+			"write then does not truncate the file"
+	);
+	desc.add_options()(
+		"retry_backoff_usec", po::value<uint64_t>()->default_value(1000),
+		"Wait before the first retry of a failed I/O. Doubles on each retry"
+	);
+	desc.add_options()(
+		"rmw_align", po::value<std::string>()->default_value("4K"),
+		"Unit that readmodifywrite reads and writes"
+	);
+	desc.add_options()(
+		"rw_sequencer", po::value<std::string>(),
+		"Access pattern of read/write: "
+			"stride:N/reverse/mixed:seqpct[:run_len]"
+	);
+	desc.add_options()(
+		"size", po::value<std::string>(&arg_size),
+		"Size of the I/O region. Required except in metadata and file mode"
+	);
+	desc.add_options()(
+		"streams", po::value<size_t>(&streams)->default_value(1),
+		"Number of independently paced streams per job. The streams of a "
+			"job share its thread and I/O engine"
+	);
+	desc.add_options()(
+		"sweep", po::value<std::vector<std::string>>(),
+		"param=value,value,... Runs every combination of the values of "
+			"the swept parameters in one process, over one file laid out "
+			"once. param is readwrite/bs/bandwidth/numjobs/iodepth, and a "
+			"bandwidth of none is unpaced. Repeat it to sweep several "
+			"parameters. Block modes only"
 	);
-	desc.add_options()("randseed", po::value<seed_t>());
-	desc.add_options()("size", po::value<std::string>(&arg_size)->required());
 	desc.add_options()("verbose", "Print extra messages");
+	desc.add_options()(
+		"work_chunk_ops", po::value<size_t>()->default_value(64),
+		"Number of I/Os per chunk in work stealing mode"
+	);
+	desc.add_options()(
+		"work_stealing",
+		"Put the I/Os of all jobs into chunks that idle jobs steal from "
+			"busy ones"
+	);
+	desc.add_options()(
+		"write_lat_log", po::value<std::string>(),
+		"Log a latency histogram per window to <prefix>_lat.<job>.log"
+	);
+	desc.add_options()(
+		"zones", po::value<std::string>(),
+		"Weight random offsets by zones of the I/O region: "
+			"pct_io/pct_space,pct_io/pct_space,..."
+	);
+	desc.add_options()(
+		"zonemode", po::value<std::string>()->default_value("none"),
+		"none/emulated/zbd. In zoned mode writes go to zone write pointers"
+	);
+	desc.add_options()(
+		"zonesize", po::value<std::string>(),
+		"Zone size of emulated zones"
+	);
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -243,28 +2486,157 @@ int main(int argc, char **argv) {
 	po::notify(vm);
 	bool verbose = vm.count("verbose");
 
+	bool group_reporting;
+	if (vm.count("group_reporting")) {
+		group_reporting = true;
+	} else {
+		group_reporting = false;
+	}
+
+	seed_t randseed;
+	if (vm.count("randseed")) {
+		randseed = vm["randseed"].as<seed_t>();
+	} else {
+		std::random_device rd;
+		randseed = std::uniform_int_distribution<seed_t>()(rd);
+	}
+	std::mt19937_64 rng(randseed);
+
+	std::string arg_clocksource = vm["clocksource"].as<std::string>();
+	if (arg_clocksource == "tsc") {
+		if (!use_tsc_clock()) {
+			std::cerr << "WARNING: no invariant TSC, using clock_gettime"
+				<< std::endl;
+		} else if (verbose) {
+			std::cout << "clocksource: tsc" << std::endl;
+		}
+	} else if (arg_clocksource != "clock_gettime") {
+		rusty_panic(
+			"Invalid argument clocksource: %s", arg_clocksource.c_str()
+		);
+	}
+
 	std::optional<size_t> bandwidth;
 	if (vm.count("bandwidth")) {
 		std::string bw = vm["bandwidth"].as<std::string>();
-		// xxxB/s, at least 4 characters
+		bandwidth = parse_bandwidth(bw);
 		rusty_assert(
-			bw.size() >= 4, "Invalid argument bandwidth: %s", bw.c_str()
+			bandwidth.has_value(), "Invalid argument bandwidth: %s", bw.c_str()
 		);
+		if (verbose) {
+			std::cout << "bandwidth: " << bandwidth.value() << "B/s"
+				<< std::endl;
+		}
+	}
+
+	IOEngineType io_engine;
+	std::string arg_ioengine = vm["ioengine"].as<std::string>();
+	std::optional<FaultConfig> faults;
+	if (arg_ioengine == "faulty") {
+		std::string arg = vm["fault_latency"].as<std::string>();
+		auto latency = parse_latency_distribution(arg);
 		rusty_assert(
-			bw[bw.size() - 3] == 'B' && bw[bw.size() - 2] == '/' &&
-				bw[bw.size() - 1] == 's',
-			"Invalid argument bandwidth: %s", bw.c_str()
+			latency.has_value(), "Invalid argument fault_latency: %s",
+			arg.c_str()
 		);
-		auto ret = parse_size(bw.data(), bw.size() - 2);
+		double error_rate = vm["fault_error_rate"].as<double>();
 		rusty_assert(
-			ret.has_value(), "Invalid argument bandwidth: %s", bw.c_str()
+			error_rate >= 0 && error_rate <= 1,
+			"fault_error_rate must be in [0, 1]"
 		);
-		bandwidth = ret.value();
-		if (verbose) {
-			std::cout << "bandwidth: " << bandwidth.value() << "B/s"
-				<< std::endl;
+		int error_errno = vm["fault_errno"].as<int>();
+		rusty_assert(error_errno > 0, "fault_errno must be positive");
+		uint64_t stall_period_ns = 0;
+		uint64_t stall_ns = 0;
+		if (vm.count("fault_stall")) {
+			std::string arg = vm["fault_stall"].as<std::string>();
+			auto v = parse_numbers(arg);
+			rusty_assert(
+				v.has_value() && v.value().size() == 2 &&
+					v.value()[0] > 0 && v.value()[1] >= 0 &&
+					v.value()[1] <= v.value()[0],
+				"Invalid argument fault_stall: %s", arg.c_str()
+			);
+			stall_period_ns = v.value()[0] * 1e6;
+			stall_ns = v.value()[1] * 1e6;
 		}
+		faults = FaultConfig{
+			.latency = latency.value(),
+			.error_rate = error_rate,
+			.error_errno = error_errno,
+			.stall_period_ns = stall_period_ns,
+			.stall_ns = stall_ns,
+		};
+		arg_ioengine = vm["faulty_ioengine"].as<std::string>();
+	}
+	if (arg_ioengine == "sync") {
+		io_engine = IOEngineType::Sync;
+	} else if (arg_ioengine == "io_uring") {
+		io_engine = IOEngineType::IoUring;
+	} else {
+		rusty_panic("Invalid argument ioengine: %s", arg_ioengine.c_str());
+	}
+	size_t iodepth = vm["iodepth"].as<size_t>();
+	rusty_assert(iodepth > 0, "iodepth must be positive");
+	rusty_assert(
+		io_engine != IOEngineType::Sync || iodepth == 1,
+		"The sync engine only supports iodepth=1"
+	);
+	size_t iodepth_batch_submit = vm["iodepth_batch_submit"].as<size_t>();
+	rusty_assert(
+		iodepth_batch_submit > 0 && iodepth_batch_submit <= iodepth,
+		"iodepth_batch_submit must be in [1, iodepth]"
+	);
+	size_t iodepth_batch_complete_min =
+		vm["iodepth_batch_complete_min"].as<size_t>();
+	size_t iodepth_batch_complete_max = iodepth;
+	if (vm.count("iodepth_batch_complete_max")) {
+		iodepth_batch_complete_max =
+			vm["iodepth_batch_complete_max"].as<size_t>();
+	}
+	rusty_assert(
+		iodepth_batch_complete_min <= iodepth_batch_complete_max &&
+			iodepth_batch_complete_max > 0 &&
+			iodepth_batch_complete_max <= iodepth,
+		"Need iodepth_batch_complete_min <= iodepth_batch_complete_max "
+			"<= iodepth"
+	);
+
+	ContinueOnError continue_on_error;
+	std::string arg_continue_on_error =
+		vm["continue_on_error"].as<std::string>();
+	if (arg_continue_on_error == "none") {
+		continue_on_error = ContinueOnError::None;
+	} else if (arg_continue_on_error == "read") {
+		continue_on_error = ContinueOnError::Read;
+	} else if (arg_continue_on_error == "write") {
+		continue_on_error = ContinueOnError::Write;
+	} else if (arg_continue_on_error == "all") {
+		continue_on_error = ContinueOnError::All;
+	} else {
+		rusty_panic(
+			"Invalid argument continue_on_error: %s",
+			arg_continue_on_error.c_str()
+		);
+	}
+	std::optional<size_t> max_errors;
+	if (vm.count("max_errors")) {
+		max_errors = vm["max_errors"].as<size_t>();
+	}
+
+	if (readwrite == "metadata") {
+		return run_metadata(vm, filename, numjobs, group_reporting, rng);
+	}
+	if (readwrite == "fileread" || readwrite == "filewrite") {
+		return run_small_files(
+			vm, filename, readwrite == "filewrite", numjobs, group_reporting,
+			bandwidth, io_engine, faults, iodepth, continue_on_error,
+			max_errors, rng
+		);
 	}
+	rusty_assert(
+		vm.count("bs") && vm.count("size"), "bs and size are required"
+	);
 
 	auto bs_ret = parse_size(arg_bs.data(), arg_bs.size());
 	rusty_assert(bs_ret.has_value(), "Invalid argument bs: %s", arg_bs.c_str());
@@ -273,32 +2645,34 @@ int main(int argc, char **argv) {
 		std::cout << "bs: " << bs << 'B' << std::endl;
 	}
 
-	bool group_reporting;
-	if (vm.count("group_reporting")) {
-		group_reporting = true;
-	} else {
-		group_reporting = false;
-	}
-
-	IOType io_type;
-	if (readwrite == "randread") {
-		io_type = IOType::RandRead;
-	} else if (readwrite == "read") {
-		io_type = IOType::Read;
-	} else if (readwrite == "write") {
-		io_type = IOType::Write;
-	} else {
-		rusty_panic("Invalid argument readwrite: %s", readwrite.c_str());
-	}
+	// precondition ends with random writes
+	bool precondition = readwrite == "precondition";
+	auto io_type_ret = parse_io_type(precondition ? "randwrite" : readwrite);
+	rusty_assert(
+		io_type_ret.has_value(), "Invalid argument readwrite: %s",
+		readwrite.c_str()
+	);
+	IOType io_type = io_type_ret.value();
 
-	seed_t randseed;
-	if (vm.count("randseed")) {
-		randseed = vm["randseed"].as<seed_t>();
-	} else {
-		std::random_device rd;
-		randseed = std::uniform_int_distribution<seed_t>()(rd);
+	Sequencer sequencer{
+		.type = SequencerType::Forward,
+		.stride_blocks = 0,
+		.seq_pct = 0,
+		.run_len = 0,
+	};
+	if (vm.count("rw_sequencer")) {
+		std::string arg = vm["rw_sequencer"].as<std::string>();
+		rusty_assert(
+			io_type == IOType::Read || io_type == IOType::Write ||
+				io_type == IOType::ReadAfterWrite,
+			"rw_sequencer only applies to read/write/readafterwrite"
+		);
+		auto ret = parse_sequencer(arg, bs);
+		rusty_assert(
+			ret.has_value(), "Invalid argument rw_sequencer: %s", arg.c_str()
+		);
+		sequencer = ret.value();
 	}
-	std::mt19937_64 rng(randseed);
 
 	auto ret = parse_size(arg_size.data(), arg_size.size());
 	rusty_assert(
@@ -318,75 +2692,311 @@ int main(int argc, char **argv) {
 		return 0;
 	}
 
-	int fd;
-	switch (io_type) {
-	case IOType::RandRead:
-	case IOType::Read:
-		for (;;) {
-			fd = open(filename.c_str(), O_DIRECT | O_RDONLY);
-			if (fd == -1) {
-				if (errno != ENOENT) {
-					perror("open");
-					rusty_panic();
-				}
-				std::cout << "Target file does not exists, writing...";
-			} else {
-				rusty_assert(fd >= 0);
-				struct stat file_stat;
-				if (fstat(fd, &file_stat) == -1) {
-					perror("fstat");
-					rusty_panic();
-				}
-				if (file_stat.st_size >= size) {
-					break;
-				}
-				std::cout << "Target file too small, rewriting...";
+	// Buffered I/O needs no alignment, so the offsets may be off the grid
+	// of bs
+	bool buffered = vm.count("buffered");
+	size_t offset = 0;
+	if (vm.count("offset")) {
+		std::string arg = vm["offset"].as<std::string>();
+		auto ret = parse_size(arg.data(), arg.size());
+		rusty_assert(
+			ret.has_value() && (buffered || ret.value() % bs == 0),
+			"Invalid argument offset: %s", arg.c_str()
+		);
+		offset = ret.value();
+	}
+	size_t offset_increment = 0;
+	if (vm.count("offset_increment")) {
+		std::string arg = vm["offset_increment"].as<std::string>();
+		auto ret = parse_size(arg.data(), arg.size());
+		rusty_assert(
+			ret.has_value() && (buffered || ret.value() % bs == 0),
+			"Invalid argument offset_increment: %s", arg.c_str()
+		);
+		offset_increment = ret.value();
+	}
+	rusty_assert(streams > 0, "streams must be positive");
+	// Every stream of every job has its own I/O region. The file has to
+	// cover the last one.
+	size_t file_size =
+		offset + (numjobs * streams - 1) * offset_increment + size;
+	if (verbose && file_size != size) {
+		std::cout << "file size in bytes: " << file_size << std::endl;
+	}
+
+	std::optional<ZoneTable> zones;
+	if (vm.count("zones")) {
+		std::string arg = vm["zones"].as<std::string>();
+		zones = parse_zones(arg, num_blocks);
+		rusty_assert(
+			zones.has_value(), "Invalid argument zones: %s", arg.c_str()
+		);
+	}
+
+	size_t block_align = bs;
+	if (vm.count("blockalign")) {
+		std::string arg = vm["blockalign"].as<std::string>();
+		auto ret = parse_size(arg.data(), arg.size());
+		rusty_assert(
+			ret.has_value() && ret.value() > 0,
+			"Invalid argument blockalign: %s", arg.c_str()
+		);
+		block_align = ret.value();
+		// Zones are made of whole blocks
+		rusty_assert(
+			!zones.has_value(), "blockalign can not be used with zones"
+		);
+	}
+
+	size_t io_size = size;
+	if (vm.count("io_size")) {
+		std::string arg = vm["io_size"].as<std::string>();
+		auto ret = parse_size(arg.data(), arg.size());
+		rusty_assert(
+			ret.has_value() && (buffered || ret.value() % bs == 0),
+			"Invalid argument io_size: %s", arg.c_str()
+		);
+		io_size = ret.value();
+	}
+	// The last I/O is a whole one
+	size_t num_ops = (io_size + bs - 1) / bs;
+	if (num_ops == 0) {
+		return 0;
+	}
+
+	ZoneMode zone_mode;
+	std::string arg_zonemode = vm["zonemode"].as<std::string>();
+	if (arg_zonemode == "none") {
+		zone_mode = ZoneMode::None;
+	} else if (arg_zonemode == "emulated") {
+		zone_mode = ZoneMode::Emulated;
+	} else if (arg_zonemode == "zbd") {
+		zone_mode = ZoneMode::Zbd;
+	} else {
+		rusty_panic("Invalid argument zonemode: %s", arg_zonemode.c_str());
+	}
+	size_t max_open_zones = vm["max_open_zones"].as<size_t>();
+	if (zone_mode != ZoneMode::None) {
+		rusty_assert(
+			io_type == IOType::Write, "zonemode only applies to write"
+		);
+		rusty_assert(
+			sequencer.type == SequencerType::Forward,
+			"rw_sequencer can not be used in zoned mode"
+		);
+		rusty_assert(max_open_zones > 0, "max_open_zones must be positive");
+		// Writes in flight to the same zone may be reordered
+		rusty_assert(
+			zone_mode != ZoneMode::Zbd || iodepth == 1,
+			"zonemode=zbd only supports iodepth=1"
+		);
+	}
+
+	std::optional<std::string> lat_log;
+	if (vm.count("write_lat_log")) {
+		lat_log = vm["write_lat_log"].as<std::string>();
+	}
+	uint64_t log_hist_msec = vm["log_hist_msec"].as<uint64_t>();
+	rusty_assert(log_hist_msec > 0, "log_hist_msec must be positive");
+	std::string arg_lat_sampling = vm["lat_sampling"].as<std::string>();
+	size_t lat_sampling = 0;
+	if (arg_lat_sampling.starts_with("1/")) {
+		try {
+			size_t pos;
+			lat_sampling = std::stoul(arg_lat_sampling.substr(2), &pos);
+			if (pos != arg_lat_sampling.size() - 2) {
+				lat_sampling = 0;
 			}
-			std::cout.flush();
-			fd = open(
-				filename.c_str(), O_DIRECT | O_WRONLY | O_CREAT | O_TRUNC,
-				S_IRUSR | S_IWUSR
+		} catch (const std::logic_error &) {
+		}
+	}
+	rusty_assert(
+		lat_sampling > 0, "Invalid argument lat_sampling: %s",
+		arg_lat_sampling.c_str()
+	);
+	std::optional<std::string> metrics_listen;
+	if (vm.count("metrics_listen")) {
+		metrics_listen = vm["metrics_listen"].as<std::string>();
+	}
+
+	size_t chase_depth = vm["chase_depth"].as<size_t>();
+	rusty_assert(chase_depth > 0, "chase_depth must be positive");
+
+	bool work_stealing = vm.count("work_stealing");
+	size_t work_chunk_ops = vm["work_chunk_ops"].as<size_t>();
+	if (work_stealing) {
+		rusty_assert(work_chunk_ops > 0, "work_chunk_ops must be positive");
+		// Chunks are ranges of consecutive blocks
+		rusty_assert(
+			sequencer.type == SequencerType::Forward &&
+				zone_mode == ZoneMode::None,
+			"work_stealing can not be used with rw_sequencer or zonemode"
+		);
+	}
+
+	std::string precondition_state = filename + ".precondition";
+	if (vm.count("precondition_state")) {
+		precondition_state = vm["precondition_state"].as<std::string>();
+	}
+	bool require_precondition = vm.count("require_precondition");
+	if (precondition) {
+		rusty_assert(
+			!vm.count("sweep") && !bandwidth.has_value(),
+			"precondition can not be used with sweep or bandwidth"
+		);
+		rusty_assert(
+			vm["precondition_rounds"].as<size_t>() > 0,
+			"precondition_rounds must be positive"
+		);
+	}
+
+	std::optional<QosSweep> qos_sweep;
+	if (vm.count("qos_sweep")) {
+		std::string arg = vm["qos_sweep"].as<std::string>();
+		qos_sweep = parse_qos_sweep(arg);
+		rusty_assert(
+			qos_sweep.has_value(), "Invalid argument qos_sweep: %s",
+			arg.c_str()
+		);
+		qos_sweep->p99_threshold_ns =
+			vm["qos_p99_usec"].as<uint64_t>() * 1000;
+		qos_sweep->max_rounds = vm["qos_max_rounds"].as<size_t>();
+		rusty_assert(
+			qos_sweep->max_rounds >= QOS_WINDOW,
+			"qos_max_rounds must be at least %zu", QOS_WINDOW
+		);
+		rusty_assert(
+			!precondition && !vm.count("sweep") && !bandwidth.has_value() &&
+				!lat_log.has_value(),
+			"qos_sweep can not be used with precondition, sweep, bandwidth "
+				"or write_lat_log"
+		);
+	}
+
+	std::optional<Sweep> sweep;
+	if (vm.count("sweep")) {
+		sweep = Sweep{
+			.io_types = {io_type},
+			.bs = {bs},
+			.bandwidth = {bandwidth},
+			.numjobs = {numjobs},
+			.iodepth = {iodepth},
+		};
+		for (
+			const std::string &arg :
+				vm["sweep"].as<std::vector<std::string>>()
+		) {
+			rusty_assert(
+				parse_sweep(arg, sweep.value()), "Invalid argument sweep: %s",
+				arg.c_str()
 			);
-			if (fd == -1) {
-				perror("open");
-				rusty_panic();
-			}
-			struct stat file_stat;
-			if (fstat(fd, &file_stat) == -1) {
-				perror("fstat");
-				rusty_panic();
-			}
-			size_t write_bs = std::min(size, (size_t)1 << 20);
-			size_t write_blocks = size / write_bs;
-			size_t remain = size % write_bs;
-			Worker worker(
-				Options{
-					.blksize = static_cast<size_t>(file_stat.st_blksize),
-					.bandwidth = std::nullopt,
-					.bs = write_bs,
-					.io_type = IOType::Write,
-					.num_blocks = size / write_bs,
-				},
-				fd, rng()
+		}
+		rusty_assert(
+			sequencer.type == SequencerType::Forward && !zones.has_value() &&
+				zone_mode == ZoneMode::None && !lat_log.has_value(),
+			"sweep can not be used with rw_sequencer, zones, zonemode or "
+				"write_lat_log"
+		);
+		for (size_t point_bs : sweep->bs) {
+			rusty_assert(
+				size % point_bs == 0 && (buffered || (
+					offset % point_bs == 0 &&
+					offset_increment % point_bs == 0 &&
+					io_size % point_bs == 0
+				)),
+				"sweep: bs %zu does not divide size, offset, "
+					"offset_increment and io_size",
+				point_bs
 			);
-			worker.run();
-			if (remain != 0) {
-				worker.pwrite(size - remain, remain);
-			}
-			rusty_assert(close(fd) == 0);
-			std::cout << " done" << std::endl;
 		}
-		break;
-	case IOType::Write:
-		if (numjobs > 1) {
-			std::cerr << "Multithread write is not supported yet." << std::endl;
-			return 1;
+		for (size_t point_iodepth : sweep->iodepth) {
+			rusty_assert(
+				io_engine != IOEngineType::Sync || point_iodepth == 1,
+				"The sync engine only supports iodepth=1"
+			);
+			rusty_assert(
+				iodepth_batch_submit <= point_iodepth &&
+					iodepth_batch_complete_min <= point_iodepth &&
+					(!vm.count("iodepth_batch_complete_max") ||
+						iodepth_batch_complete_max <= point_iodepth),
+				"sweep: iodepth %zu is below an iodepth_batch option",
+				point_iodepth
+			);
 		}
+		// The points share the file, so it covers the most jobs
+		size_t max_numjobs =
+			*std::max_element(sweep->numjobs.begin(), sweep->numjobs.end());
+		file_size =
+			offset + (max_numjobs * streams - 1) * offset_increment + size;
+	}
+
+	size_t rmw_align = 0;
+	if (
+		io_type == IOType::ReadModifyWrite ||
+		(sweep.has_value() && std::count(
+			sweep->io_types.begin(), sweep->io_types.end(),
+			IOType::ReadModifyWrite
+		))
+	) {
+		std::string arg = vm["rmw_align"].as<std::string>();
+		auto ret = parse_size(arg.data(), arg.size());
+		rusty_assert(
+			ret.has_value() && ret.value() > 0,
+			"Invalid argument rmw_align: %s", arg.c_str()
+		);
+		rmw_align = ret.value();
+		// The range around an update at the end of the I/O region may
+		// reach past it
+		file_size = (file_size + rmw_align - 1) / rmw_align * rmw_align;
+	}
+
+	// Against the whole region, which the sweep and readmodifywrite may
+	// have grown
+	if (require_precondition && !precondition) {
+		check_precondition(filename, file_size, precondition_state);
+	}
+
+	int direct = buffered ? 0 : O_DIRECT;
+	int fd = -1;
+	if (sweep.has_value()) {
+		// Laid out once for all points. Writes go to it in place.
+		fd = open_prefilled(filename, file_size, direct | O_RDWR, rng);
+	} else if (precondition) {
 		fd = open(
-			filename.c_str(), O_DIRECT | O_WRONLY | O_CREAT | O_TRUNC,
-			S_IRUSR | S_IWUSR
+			filename.c_str(), direct | O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR
 		);
-		break;
+	} else {
+		switch (io_type) {
+		case IOType::RandRead:
+		case IOType::Read:
+		case IOType::PointerChase:
+			fd = open_prefilled(filename, file_size, direct | O_RDONLY, rng);
+			break;
+		case IOType::RandWrite:
+			fd = open_prefilled(filename, file_size, direct | O_WRONLY, rng);
+			break;
+		case IOType::ReadModifyWrite:
+			fd = open_prefilled(filename, file_size, direct | O_RDWR, rng);
+			break;
+		case IOType::Write:
+		case IOType::ReadAfterWrite:
+			if (numjobs > 1) {
+				std::cerr << "Multithread write is not supported yet."
+					<< std::endl;
+				return 1;
+			}
+			// Zoned devices can not be truncated. Emulated zones are reset
+			// one by one when the writer reaches them.
+			fd = open(
+				filename.c_str(),
+				direct | O_CREAT |
+					(io_type == IOType::Write ? O_WRONLY : O_RDWR) |
+					(zone_mode == ZoneMode::None && !require_precondition ?
+						O_TRUNC : 0),
+				S_IRUSR | S_IWUSR
+			);
+			break;
+		}
 	}
 	if (fd == -1) {
 		perror("open");
@@ -398,48 +3008,203 @@ int main(int argc, char **argv) {
 		perror("fstat");
 		rusty_panic();
 	}
+	// The aligned ranges are read with O_DIRECT unless buffered
+	rusty_assert(
+		direct == 0 || rmw_align % file_stat.st_blksize == 0,
+		"rmw_align must be a multiple of the block size of the file, %zu, "
+			"unless buffered", (size_t)file_stat.st_blksize
+	);
+	rusty_assert(
+		direct == 0 || block_align % file_stat.st_blksize == 0,
+		"blockalign must be a multiple of the block size of the file, %zu, "
+			"unless buffered", (size_t)file_stat.st_blksize
+	);
+	size_t zone_size = 0;
+	switch (zone_mode) {
+	case ZoneMode::None:
+		break;
+	case ZoneMode::Emulated: {
+		rusty_assert(vm.count("zonesize"), "Emulated zones need zonesize");
+		std::string arg = vm["zonesize"].as<std::string>();
+		auto ret = parse_size(arg.data(), arg.size());
+		rusty_assert(
+			ret.has_value(), "Invalid argument zonesize: %s", arg.c_str()
+		);
+		zone_size = ret.value();
+	} break;
+	case ZoneMode::Zbd: {
+		uint32_t sectors;
+		if (ioctl(fd, BLKGETZONESZ, &sectors) == -1) {
+			perror("ioctl BLKGETZONESZ");
+			rusty_panic();
+		}
+		rusty_assert(sectors != 0, "%s is not zoned", filename.c_str());
+		zone_size = (size_t)sectors << 9;
+		if (vm.count("zonesize")) {
+			std::string arg = vm["zonesize"].as<std::string>();
+			auto ret = parse_size(arg.data(), arg.size());
+			rusty_assert(
+				ret.has_value() && ret.value() == zone_size,
+				"zonesize %s does not match the zone size %zu of the device",
+				arg.c_str(), zone_size
+			);
+		}
+	} break;
+	}
+	if (zone_mode != ZoneMode::None) {
+		rusty_assert(
+			zone_size >= bs && zone_size % bs == 0 && size % zone_size == 0 &&
+				offset % zone_size == 0,
+			"zonesize must be a multiple of bs and divide size and offset"
+		);
+		// Each stream writes zones of its own
+		rusty_assert(
+			streams == 1 || (
+				offset_increment >= size &&
+				offset_increment % zone_size == 0
+			),
+			"With streams in zoned mode, offset_increment must be at least "
+				"size and a multiple of zonesize"
+		);
+		if (verbose) {
+			std::cout << "zone size: " << zone_size << "B, "
+				<< size / zone_size << " zones" << std::endl;
+		}
+	}
+
 	Options options {
 		.blksize = static_cast<size_t>(file_stat.st_blksize),
 		.bandwidth = bandwidth,
 		.bs = bs,
+		.block_align = block_align,
 		.io_type = io_type,
 		.num_blocks = num_blocks,
+		.num_ops = num_ops,
+		.streams = streams,
+		.sequencer = sequencer,
+		.offset = offset,
+		.offset_increment = offset_increment,
+		.zones = zones,
+		.zone_mode = zone_mode,
+		.zone_size = zone_size,
+		.max_open_zones = max_open_zones,
+		.io_engine = io_engine,
+		.iodepth = iodepth,
+		.iodepth_batch_submit = iodepth_batch_submit,
+		.iodepth_batch_complete_min = iodepth_batch_complete_min,
+		.iodepth_batch_complete_max = iodepth_batch_complete_max,
+		.work_chunk_ops = work_chunk_ops,
+		.lat_log = lat_log,
+		.lat_log_window_ns = log_hist_msec * 1000000,
+		.lat_sampling = lat_sampling,
+		.continue_on_error = continue_on_error,
+		.io_retries = vm["io_retries"].as<size_t>(),
+		.retry_backoff_ns = vm["retry_backoff_usec"].as<uint64_t>() * 1000,
+		.max_errors = max_errors,
+		.faults = faults,
+		.raw_delay_ns = vm["raw_delay_usec"].as<uint64_t>() * 1000,
+		.chase_depth = chase_depth,
+		.rmw_align = rmw_align,
 	};
 
-	std::vector<Worker> workers;
-	workers.reserve(numjobs);
-	std::vector<std::thread> threads;
-	for (size_t i = 0; i < numjobs; ++i) {
-		workers.emplace_back(options, fd, rng());
-	}
-	auto run_start = rusty::time::Instant::now();
-	for (size_t i = 0; i < numjobs; ++i) {
-		threads.emplace_back([&workers, i] { workers[i].run(); });
+	if (precondition) {
+		run_precondition(
+			options, numjobs, fd, file_size,
+			vm["precondition_rounds"].as<size_t>(), precondition_state,
+			metrics_listen, rng
+		);
+		return 0;
 	}
-	for (size_t i = 0; i < numjobs; ++i) {
-		threads[i].join();
+	std::string command;
+	for (int i = 0; i < argc; ++i) {
+		command += (i ? " " : "") + std::string(argv[i]);
 	}
-	auto run_time = run_start.elapsed();
-	if (numjobs > 1 && group_reporting) {
-		auto io_time = rusty::time::Duration::from_nanos(0);
-		for (size_t i = 0; i < numjobs; ++i) {
-			io_time += workers[i].io_time();
+	if (qos_sweep.has_value()) {
+		std::vector<SweepPoint> points = run_qos_sweep(
+			options, numjobs, fd, group_reporting, metrics_listen,
+			qos_sweep.value(), rng
+		);
+		if (vm.count("json_output")) {
+			write_sweep_result(
+				vm["json_output"].as<std::string>(), command, points
+			);
 		}
-		std::cout << "Throughput "
-			<< size * numjobs / run_time.as_secs_double() / 1e6
-			<< "MB/s, avg latency " << io_time.as_nanos() / (num_blocks * numjobs)
-			<< "ns" << std::endl;
-	} else {
-		for (size_t i = 0; i < numjobs; ++i) {
-			if (numjobs > 1) {
-				std::cout << i << ": ";
+		return 0;
+	}
+	if (sweep.has_value()) {
+		const Sweep &s = sweep.value();
+		size_t num_points = s.io_types.size() * s.bs.size() *
+			s.bandwidth.size() * s.numjobs.size() * s.iodepth.size();
+		std::vector<SweepPoint> points;
+		for (size_t i = 0; i < num_points; ++i) {
+			// The last parameter varies fastest
+			size_t rest = i;
+			auto pick = [&rest](const auto &values) {
+				auto value = values[rest % values.size()];
+				rest /= values.size();
+				return value;
+			};
+			size_t point_iodepth = pick(s.iodepth);
+			size_t point_numjobs = pick(s.numjobs);
+			std::optional<size_t> point_bandwidth = pick(s.bandwidth);
+			size_t point_bs = pick(s.bs);
+			IOType point_io_type = pick(s.io_types);
+			std::cout << "== readwrite=" << io_type_name(point_io_type)
+				<< " bs=" << point_bs << " bandwidth=";
+			if (point_bandwidth.has_value()) {
+				std::cout << point_bandwidth.value() << "B/s";
+			} else {
+				std::cout << "none";
 			}
-			std::cout << "throughput "
-				<< size / workers[i].run_time().as_secs_double() / 1e6
-				<< "MB/s, avg latency "
-				<< workers[i].io_time().as_nanos() / num_blocks << "ns"
-				<< std::endl;
+			std::cout << " numjobs=" << point_numjobs << " iodepth="
+				<< point_iodepth << std::endl;
+			if (
+				point_numjobs > 1 && (point_io_type == IOType::Write ||
+					point_io_type == IOType::ReadAfterWrite)
+			) {
+				std::cout << "Skipped, multithread write is not supported yet."
+					<< std::endl;
+				continue;
+			}
+			Options point = options;
+			point.bandwidth = point_bandwidth;
+			point.bs = point_bs;
+			point.io_type = point_io_type;
+			point.num_blocks = size / point_bs;
+			point.num_ops = (io_size + point_bs - 1) / point_bs;
+			if (!vm.count("blockalign")) {
+				point.block_align = point_bs;
+			}
+			point.iodepth = point_iodepth;
+			if (!vm.count("iodepth_batch_complete_max")) {
+				point.iodepth_batch_complete_max = point_iodepth;
+			}
+			points.push_back(SweepPoint{
+				.readwrite = io_type_name(point_io_type),
+				.bs = point_bs,
+				.bandwidth = point_bandwidth,
+				.numjobs = point_numjobs,
+				.iodepth = point_iodepth,
+				.result = run_jobs(
+					point, point_numjobs, fd, group_reporting, work_stealing,
+					metrics_listen, rng
+				),
+			});
+		}
+		if (vm.count("json_output")) {
+			write_sweep_result(
+				vm["json_output"].as<std::string>(), command, points
+			);
 		}
+		return 0;
+	}
+	RunResult result = run_jobs(
+		options, numjobs, fd, group_reporting, work_stealing, metrics_listen,
+		rng
+	);
+	if (vm.count("json_output")) {
+		result.command = std::move(command);
+		write_result(vm["json_output"].as<std::string>(), result);
 	}
 
 	return 0;
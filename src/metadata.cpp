@@ -0,0 +1,263 @@
+#include "metadata.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <rusty/macro.h>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *const METADATA_OP_NAMES[NUM_METADATA_OPS] = {
+	"create", "open", "stat", "fsync_dir", "rename", "unlink",
+};
+
+const char *metadata_op_name(MetadataOp op) {
+	return METADATA_OP_NAMES[(size_t)op];
+}
+
+std::optional<std::array<double, NUM_METADATA_OPS>> parse_metadata_mix(
+	const std::string &s
+) {
+	std::array<double, NUM_METADATA_OPS> mix{};
+	double total = 0;
+	size_t begin = 0;
+	for (;;) {
+		size_t comma = s.find(',', begin);
+		std::string item = s.substr(begin, comma - begin);
+		size_t colon = item.find(':');
+		if (colon == std::string::npos) {
+			return std::nullopt;
+		}
+		std::string name = item.substr(0, colon);
+		std::string weight = item.substr(colon + 1);
+		size_t op = 0;
+		while (op < NUM_METADATA_OPS && name != METADATA_OP_NAMES[op]) {
+			op += 1;
+		}
+		if (op == NUM_METADATA_OPS) {
+			return std::nullopt;
+		}
+		try {
+			size_t pos;
+			mix[op] = std::stod(weight, &pos);
+			if (pos != weight.size() || mix[op] < 0) {
+				return std::nullopt;
+			}
+		} catch (const std::logic_error &) {
+			return std::nullopt;
+		}
+		total += mix[op];
+		if (comma == std::string::npos) {
+			break;
+		}
+		begin = comma + 1;
+	}
+	if (total <= 0) {
+		return std::nullopt;
+	}
+	return mix;
+}
+
+MetadataWorker::MetadataWorker(
+	const MetadataOptions &options, size_t id, uint64_t seed
+) : options_(options),
+	rng_(seed),
+	tree_(options_.dir, id, options_.nrfiles, options_.files_per_dir),
+	pos_(options_.nrfiles),
+	set_of_(options_.nrfiles),
+	run_time_(rusty::time::Duration::from_nanos(0)) {
+	// Files left over by an earlier run are overwritten or removed
+	for (size_t i = 0; i < options_.nrfiles; ++i) {
+		std::string name = FileTree::file_name(i);
+		Set set = i < options_.nrfiles / 2 ? Present : Absent;
+		if (set == Present) {
+			int fd = openat(
+				tree_.dir_fd(i), name.c_str(), O_CREAT | O_TRUNC | O_WRONLY,
+				S_IRUSR | S_IWUSR
+			);
+			if (fd == -1) {
+				perror("openat");
+				rusty_panic();
+			}
+			close(fd);
+		} else if (unlinkat(tree_.dir_fd(i), name.c_str(), 0) == -1) {
+			if (errno != ENOENT) {
+				perror("unlinkat");
+				rusty_panic();
+			}
+		}
+		pos_[i] = sets_[set].size();
+		set_of_[i] = set;
+		sets_[set].push_back(i);
+	}
+}
+
+MetadataWorker::MetadataWorker(MetadataWorker &&other)
+  : options_(other.options_),
+	rng_(other.rng_),
+	tree_(std::move(other.tree_)),
+	sets_(std::move(other.sets_)),
+	pos_(std::move(other.pos_)),
+	set_of_(std::move(other.set_of_)),
+	latency_(other.latency_),
+	pacing_(other.pacing_),
+	run_time_(other.run_time_) {}
+
+void MetadataWorker::run(rusty::time::Instant start) {
+	std::optional<rusty::time::Duration> wait =
+		start.checked_duration_since(rusty::time::Instant::now());
+	if (wait.has_value()) {
+		std::this_thread::sleep_for(
+			std::chrono::nanoseconds(wait.value().as_nanos())
+		);
+	}
+	for (size_t i = 0; i < options_.num_ops; ++i) {
+		if (options_.interval_ns.has_value()) {
+			uint64_t tick = i * options_.interval_ns.value();
+			uint64_t now = start.elapsed().as_nanos();
+			if (now < tick) {
+				std::this_thread::sleep_for(std::chrono::nanoseconds(tick - now));
+				now = start.elapsed().as_nanos();
+			}
+			pacing_.record(
+				now > tick ? now - tick : 0, options_.interval_ns.value()
+			);
+		}
+		MetadataOp op = pick_op();
+		rusty::time::Instant op_start = rusty::time::Instant::now();
+		do_op(op);
+		latency_[(size_t)op].record(op_start.elapsed().as_nanos());
+	}
+	run_time_ += start.elapsed();
+}
+
+MetadataOp MetadataWorker::pick_op() {
+	double total = 0;
+	for (double w : options_.mix) {
+		total += w;
+	}
+	double r = std::uniform_real_distribution<double>(0, total)(rng_);
+	size_t op = 0;
+	while (op + 1 < NUM_METADATA_OPS && r >= options_.mix[op]) {
+		r -= options_.mix[op];
+		op += 1;
+	}
+	// Skip zero weights that the rounding may have landed on
+	while (options_.mix[op] == 0) {
+		op -= 1;
+	}
+	// An op that needs a file that exists creates one if there is none,
+	// and the other way around
+	switch ((MetadataOp)op) {
+	case MetadataOp::Create:
+		return sets_[Absent].empty() ? MetadataOp::Unlink : MetadataOp::Create;
+	case MetadataOp::Rename:
+		if (sets_[Absent].empty()) {
+			return MetadataOp::Unlink;
+		}
+		[[fallthrough]];
+	case MetadataOp::Open:
+	case MetadataOp::Stat:
+	case MetadataOp::Unlink:
+		return sets_[Present].empty() ? MetadataOp::Create : (MetadataOp)op;
+	case MetadataOp::FsyncDir:
+		return MetadataOp::FsyncDir;
+	}
+	rusty_panic("Unknown metadata op");
+}
+
+void MetadataWorker::do_op(MetadataOp op) {
+	switch (op) {
+	case MetadataOp::Create: {
+		size_t file = pick(Absent);
+		int fd = openat(
+			tree_.dir_fd(file), FileTree::file_name(file).c_str(),
+			O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR
+		);
+		if (fd == -1) {
+			perror("openat");
+			rusty_panic();
+		}
+		close(fd);
+		move_to(file, Present);
+	} break;
+	case MetadataOp::Open: {
+		size_t file = pick(Present);
+		int fd = openat(
+			tree_.dir_fd(file), FileTree::file_name(file).c_str(), O_RDONLY
+		);
+		if (fd == -1) {
+			perror("openat");
+			rusty_panic();
+		}
+		close(fd);
+	} break;
+	case MetadataOp::Stat: {
+		size_t file = pick(Present);
+		struct stat st;
+		if (
+			fstatat(
+				tree_.dir_fd(file), FileTree::file_name(file).c_str(), &st, 0
+			) == -1
+		) {
+			perror("fstatat");
+			rusty_panic();
+		}
+	} break;
+	case MetadataOp::FsyncDir: {
+		size_t dir = std::uniform_int_distribution<size_t>(
+			0, tree_.num_dirs() - 1
+		)(rng_);
+		if (fsync(tree_.dir(dir)) == -1) {
+			perror("fsync");
+			rusty_panic();
+		}
+	} break;
+	case MetadataOp::Rename: {
+		size_t from = pick(Present);
+		size_t to = pick(Absent);
+		if (
+			renameat(
+				tree_.dir_fd(from), FileTree::file_name(from).c_str(),
+				tree_.dir_fd(to), FileTree::file_name(to).c_str()
+			) == -1
+		) {
+			perror("renameat");
+			rusty_panic();
+		}
+		move_to(from, Absent);
+		move_to(to, Present);
+	} break;
+	case MetadataOp::Unlink: {
+		size_t file = pick(Present);
+		if (
+			unlinkat(
+				tree_.dir_fd(file), FileTree::file_name(file).c_str(), 0
+			) == -1
+		) {
+			perror("unlinkat");
+			rusty_panic();
+		}
+		move_to(file, Absent);
+	} break;
+	}
+}
+
+size_t MetadataWorker::pick(Set set) {
+	const std::vector<size_t> &files = sets_[set];
+	return files[std::uniform_int_distribution<size_t>(0, files.size() - 1)(rng_)];
+}
+
+void MetadataWorker::move_to(size_t file, Set set) {
+	std::vector<size_t> &from = sets_[set_of_[file]];
+	size_t last = from.back();
+	from[pos_[file]] = last;
+	pos_[last] = pos_[file];
+	from.pop_back();
+	pos_[file] = sets_[set].size();
+	set_of_[file] = set;
+	sets_[set].push_back(file);
+}
@@ -0,0 +1,95 @@
+#ifndef METADATA_H_
+#define METADATA_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <rusty/time.h>
+#include <string>
+#include <vector>
+
+#include "file_tree.h"
+#include "histogram.h"
+#include "pacing.h"
+
+enum class MetadataOp {
+	// Creates an absent file
+	Create,
+	// Opens and closes an existing file
+	Open,
+	Stat,
+	// fsync of a directory
+	FsyncDir,
+	// Renames an existing file to an absent name
+	Rename,
+	Unlink,
+};
+
+constexpr size_t NUM_METADATA_OPS = 6;
+
+const char *metadata_op_name(MetadataOp op);
+
+struct MetadataOptions {
+	std::string dir;
+	// Number of file names per job. Half of them exist at the start.
+	size_t nrfiles;
+	size_t files_per_dir;
+	// Number of ops per job
+	size_t num_ops;
+	std::optional<uint64_t> interval_ns;
+	// Relative weight of each op, indexed by MetadataOp
+	std::array<double, NUM_METADATA_OPS> mix;
+};
+
+// Parses op:weight,op:weight,... where op is create/open/stat/fsync_dir/
+// rename/unlink. Ops not listed get weight 0.
+std::optional<std::array<double, NUM_METADATA_OPS>> parse_metadata_mix(
+	const std::string &s
+);
+
+// Issues metadata ops at a fixed rate over a tree of its own,
+// <dir>/job<id>/d<k>/f<i>. Ops are picked by their weights, and each
+// picks a random file that exists or is absent as the op needs.
+class MetadataWorker {
+public:
+	// Creates the tree
+	MetadataWorker(const MetadataOptions &options, size_t id, uint64_t seed);
+	MetadataWorker(MetadataWorker &&other);
+	MetadataWorker(const MetadataWorker &) = delete;
+	// Starts issuing ops at start, which may be in the future
+	void run(rusty::time::Instant start);
+	// Latency of each op, indexed by MetadataOp
+	const std::array<Histogram, NUM_METADATA_OPS> &latency() const {
+		return latency_;
+	}
+	// Empty if not paced
+	const PacingStats &pacing() const { return pacing_; }
+	rusty::time::Duration run_time() const { return run_time_; }
+
+private:
+	enum Set {
+		Present,
+		Absent,
+	};
+
+	MetadataOp pick_op();
+	void do_op(MetadataOp op);
+	size_t pick(Set set);
+	void move_to(size_t file, Set set);
+
+	const MetadataOptions &options_;
+	std::mt19937_64 rng_;
+	FileTree tree_;
+	// Indices of the files that exist and of those that do not
+	std::array<std::vector<size_t>, 2> sets_;
+	// Position of each file in its set
+	std::vector<size_t> pos_;
+	std::vector<Set> set_of_;
+	std::array<Histogram, NUM_METADATA_OPS> latency_;
+	PacingStats pacing_;
+	rusty::time::Duration run_time_;
+};
+
+#endif // METADATA_H_
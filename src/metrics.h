@@ -0,0 +1,58 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Counters of a job that other threads may read while it runs. Only the
+// thread of the job writes them, so an update is a relaxed load and store
+// rather than an atomic read-modify-write. The counters of each job start
+// on a cache line of their own, so that jobs next to each other in a
+// vector do not write to the same line.
+struct alignas(CACHE_LINE_SIZE) JobMetrics {
+	// latency_buckets[i] counts latencies of bit width i, i.e. in
+	// [2^(i-1), 2^i) nanoseconds
+	static constexpr size_t LATENCY_BUCKETS = 65;
+
+	std::atomic<uint64_t> ops{0};
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> latency_sum_ns{0};
+	std::array<std::atomic<uint64_t>, LATENCY_BUCKETS> latency_buckets{};
+	// Lag of the last I/O behind its pacing tick
+	std::atomic<uint64_t> lag_ns{0};
+	std::atomic<uint64_t> late_ops{0};
+	// Failed I/Os, after retries
+	std::atomic<uint64_t> errors{0};
+	std::atomic<uint64_t> retries{0};
+
+	static void add(std::atomic<uint64_t> &counter, uint64_t n) {
+		counter.store(
+			counter.load(std::memory_order_relaxed) + n,
+			std::memory_order_relaxed
+		);
+	}
+	void record_io(size_t len) {
+		add(ops, 1);
+		add(bytes, len);
+	}
+	// Only for the I/Os whose latency is sampled
+	void record_latency(uint64_t latency_ns) {
+		add(latency_sum_ns, latency_ns);
+		size_t width = latency_ns == 0 ? 0 : 64 - __builtin_clzll(latency_ns);
+		add(latency_buckets[width], 1);
+	}
+	void record_error() { add(errors, 1); }
+	void record_retry() { add(retries, 1); }
+	void record_lag(uint64_t lag, bool late) {
+		lag_ns.store(lag, std::memory_order_relaxed);
+		if (late) {
+			add(late_ops, 1);
+		}
+	}
+};
+
+#endif // METRICS_H_
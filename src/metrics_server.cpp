@@ -0,0 +1,318 @@
+#include "metrics_server.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <rusty/macro.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Latency histogram buckets exposed, as bit widths of nanoseconds. They
+// range from about 1us to 17s.
+constexpr size_t MIN_EXPOSED_WIDTH = 10;
+constexpr size_t MAX_EXPOSED_WIDTH = 34;
+
+static int listen_unix(const std::string &path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	rusty_assert(
+		!path.empty() && path.size() < sizeof(addr.sun_path),
+		"Invalid unix socket path: %s", path.c_str()
+	);
+	memcpy(addr.sun_path, path.data(), path.size());
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		perror("socket");
+		rusty_panic();
+	}
+	// Left over by an earlier run
+	unlink(path.c_str());
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		perror("bind");
+		rusty_panic("Failed to bind to %s", path.c_str());
+	}
+	return fd;
+}
+
+static int listen_inet(const std::string &listen) {
+	std::string host = "127.0.0.1";
+	std::string port = listen;
+	size_t colon = listen.rfind(':');
+	if (colon != std::string::npos) {
+		host = listen.substr(0, colon);
+		port = listen.substr(colon + 1);
+	}
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	char *end;
+	unsigned long port_num = strtoul(port.c_str(), &end, 10);
+	rusty_assert(
+		!port.empty() && *end == '\0' && port_num <= 65535 &&
+			inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1,
+		"Invalid metrics listen address: %s", listen.c_str()
+	);
+	addr.sin_port = htons(port_num);
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		perror("socket");
+		rusty_panic();
+	}
+	int one = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1) {
+		perror("setsockopt");
+		rusty_panic();
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		perror("bind");
+		rusty_panic("Failed to bind to %s", listen.c_str());
+	}
+	return fd;
+}
+
+MetricsServer::MetricsServer(
+	const std::string &listen, const std::vector<JobMetrics> &jobs
+) : jobs_(jobs) {
+	const std::string unix_prefix = "unix:";
+	if (listen.compare(0, unix_prefix.size(), unix_prefix) == 0) {
+		unix_path_ = listen.substr(unix_prefix.size());
+		listen_fd_ = listen_unix(unix_path_);
+	} else {
+		listen_fd_ = listen_inet(listen);
+	}
+	if (::listen(listen_fd_, 16) == -1) {
+		perror("listen");
+		rusty_panic();
+	}
+	stop_fd_ = eventfd(0, EFD_CLOEXEC);
+	if (stop_fd_ == -1) {
+		perror("eventfd");
+		rusty_panic();
+	}
+	thread_ = std::thread([this] { serve(); });
+}
+
+MetricsServer::~MetricsServer() {
+	uint64_t one = 1;
+	if (write(stop_fd_, &one, sizeof(one)) != sizeof(one)) {
+		perror("write");
+		rusty_panic();
+	}
+	thread_.join();
+	close(stop_fd_);
+	close(listen_fd_);
+	if (!unix_path_.empty()) {
+		unlink(unix_path_.c_str());
+	}
+}
+
+void MetricsServer::serve() {
+	for (;;) {
+		struct pollfd fds[2] = {
+			{.fd = listen_fd_, .events = POLLIN, .revents = 0},
+			{.fd = stop_fd_, .events = POLLIN, .revents = 0},
+		};
+		if (poll(fds, 2, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			rusty_panic();
+		}
+		if (fds[1].revents) {
+			return;
+		}
+		if (!fds[0].revents) {
+			continue;
+		}
+		int conn = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+		if (conn == -1) {
+			// The client may have gone already
+			continue;
+		}
+		handle(conn);
+		close(conn);
+	}
+}
+
+static bool send_all(int fd, const std::string &data) {
+	size_t sent = 0;
+	while (sent < data.size()) {
+		ssize_t ret =
+			send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		sent += ret;
+	}
+	return true;
+}
+
+void MetricsServer::handle(int conn) {
+	// A stuck client must not hold up the server for long
+	struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+	setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	std::string request;
+	char buf[1024];
+	while (request.find("\r\n\r\n") == std::string::npos) {
+		if (request.size() > 8192) {
+			return;
+		}
+		ssize_t ret = recv(conn, buf, sizeof(buf), 0);
+		if (ret == -1 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return;
+		}
+		request.append(buf, ret);
+	}
+	std::string status;
+	std::string body;
+	if (
+		request.compare(0, 13, "GET /metrics ") == 0 ||
+		request.compare(0, 6, "GET / ") == 0
+	) {
+		status = "200 OK";
+		body = render();
+	} else {
+		status = "404 Not Found";
+	}
+	send_all(
+		conn,
+		"HTTP/1.1 " + status + "\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n"
+			"Connection: close\r\n\r\n" + body
+	);
+}
+
+static void append_header(
+	std::string &out, const char *name, const char *type, const char *help
+) {
+	out += std::string("# HELP ") + name + " " + help + "\n";
+	out += std::string("# TYPE ") + name + " " + type + "\n";
+}
+
+static void append_sample(
+	std::string &out, const char *name, size_t job, const char *le,
+	double value
+) {
+	char line[256];
+	if (le == nullptr) {
+		snprintf(line, sizeof(line), "%s{job=\"%zu\"} %.17g\n", name, job, value);
+	} else {
+		snprintf(
+			line, sizeof(line), "%s{job=\"%zu\",le=\"%s\"} %.17g\n", name, job,
+			le, value
+		);
+	}
+	out += line;
+}
+
+std::string MetricsServer::render() const {
+	std::string out;
+	append_header(
+		out, "io_fixed_throughput_ops_total", "counter",
+		"Number of I/Os completed"
+	);
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		append_sample(
+			out, "io_fixed_throughput_ops_total", i, nullptr,
+			jobs_[i].ops.load(std::memory_order_relaxed)
+		);
+	}
+	append_header(
+		out, "io_fixed_throughput_bytes_total", "counter",
+		"Number of bytes transferred"
+	);
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		append_sample(
+			out, "io_fixed_throughput_bytes_total", i, nullptr,
+			jobs_[i].bytes.load(std::memory_order_relaxed)
+		);
+	}
+	append_header(
+		out, "io_fixed_throughput_errors_total", "counter",
+		"Number of failed I/Os after retries"
+	);
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		append_sample(
+			out, "io_fixed_throughput_errors_total", i, nullptr,
+			jobs_[i].errors.load(std::memory_order_relaxed)
+		);
+	}
+	append_header(
+		out, "io_fixed_throughput_retries_total", "counter",
+		"Number of retries of failed I/Os"
+	);
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		append_sample(
+			out, "io_fixed_throughput_retries_total", i, nullptr,
+			jobs_[i].retries.load(std::memory_order_relaxed)
+		);
+	}
+	append_header(
+		out, "io_fixed_throughput_pacing_lag_seconds", "gauge",
+		"Lag of the last I/O behind its pacing tick"
+	);
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		append_sample(
+			out, "io_fixed_throughput_pacing_lag_seconds", i, nullptr,
+			jobs_[i].lag_ns.load(std::memory_order_relaxed) / 1e9
+		);
+	}
+	append_header(
+		out, "io_fixed_throughput_late_ops_total", "counter",
+		"Number of I/Os issued late behind their pacing tick"
+	);
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		append_sample(
+			out, "io_fixed_throughput_late_ops_total", i, nullptr,
+			jobs_[i].late_ops.load(std::memory_order_relaxed)
+		);
+	}
+	append_header(
+		out, "io_fixed_throughput_latency_seconds", "histogram",
+		"Latency of I/Os"
+	);
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		const JobMetrics &job = jobs_[i];
+		uint64_t count = 0;
+		for (size_t w = 0; w < JobMetrics::LATENCY_BUCKETS; ++w) {
+			count += job.latency_buckets[w].load(std::memory_order_relaxed);
+			if (w >= MIN_EXPOSED_WIDTH && w <= MAX_EXPOSED_WIDTH) {
+				// Bucket w holds latencies below 2^w ns
+				char le[32];
+				snprintf(le, sizeof(le), "%.9g", (double)((uint64_t)1 << w) / 1e9);
+				append_sample(
+					out, "io_fixed_throughput_latency_seconds_bucket", i, le,
+					count
+				);
+			}
+		}
+		append_sample(
+			out, "io_fixed_throughput_latency_seconds_bucket", i, "+Inf", count
+		);
+		append_sample(
+			out, "io_fixed_throughput_latency_seconds_sum", i, nullptr,
+			job.latency_sum_ns.load(std::memory_order_relaxed) / 1e9
+		);
+		append_sample(
+			out, "io_fixed_throughput_latency_seconds_count", i, nullptr, count
+		);
+	}
+	return out;
+}
@@ -0,0 +1,34 @@
+#ifndef METRICS_SERVER_H_
+#define METRICS_SERVER_H_
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+
+// Serves the metrics of the jobs in the Prometheus text format over HTTP
+// from a thread of its own. It only reads the atomics of the jobs, so the
+// jobs never wait for a scrape.
+class MetricsServer {
+public:
+	// listen is either "unix:<path>" or "[<IPv4 address>:]<port>". The
+	// address defaults to the loopback.
+	MetricsServer(const std::string &listen, const std::vector<JobMetrics> &jobs);
+	MetricsServer(const MetricsServer &) = delete;
+	~MetricsServer();
+
+private:
+	void serve();
+	void handle(int conn);
+	std::string render() const;
+
+	const std::vector<JobMetrics> &jobs_;
+	std::string unix_path_;
+	int listen_fd_;
+	// Written to stop the server thread
+	int stop_fd_;
+	std::thread thread_;
+};
+
+#endif // METRICS_SERVER_H_
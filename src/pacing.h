@@ -0,0 +1,44 @@
+#ifndef PACING_H_
+#define PACING_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "histogram.h"
+
+// An I/O issued more than this after its pacing tick is late. Smaller
+// slips are timer and scheduling jitter.
+constexpr uint64_t LATE_THRESHOLD_NS = 1000000;
+// A job with a larger share of late I/Os did not keep up with its rate,
+// even if it caught up by the end
+constexpr double LATE_WARN_FRACTION = 0.01;
+
+// How far behind schedule the I/Os of a paced job were issued
+struct PacingStats {
+	// Lag of each I/O behind its tick in nanoseconds
+	Histogram lag;
+	size_t late_ops = 0;
+	// Schedule time covered by late I/Os, i.e. the time the job could not
+	// keep up with the rate
+	uint64_t behind_ns = 0;
+	// Lag of the last I/O. A job that could not catch up ends behind.
+	uint64_t last_lag_ns = 0;
+
+	void record(uint64_t lag_ns, uint64_t interval_ns) {
+		lag.record(lag_ns);
+		if (lag_ns > LATE_THRESHOLD_NS) {
+			late_ops += 1;
+			behind_ns += interval_ns;
+		}
+		last_lag_ns = lag_ns;
+	}
+	void merge(const PacingStats &other) {
+		lag.merge(other.lag);
+		late_ops += other.late_ops;
+		behind_ns += other.behind_ns;
+		last_lag_ns = std::max(last_lag_ns, other.last_lag_ns);
+	}
+};
+
+#endif // PACING_H_
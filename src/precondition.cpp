@@ -0,0 +1,95 @@
+#include "precondition.h"
+
+#include <algorithm>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <rusty/macro.h>
+
+// Version of the format of state files
+constexpr int STATE_VERSION = 1;
+
+bool is_steady_state(const std::vector<double> &values, size_t window) {
+	if (values.size() < window || window < 2) {
+		return false;
+	}
+	auto first = values.end() - window;
+	auto [min, max] = std::minmax_element(first, values.end());
+	double mean = 0;
+	for (auto it = first; it != values.end(); ++it) {
+		mean += *it;
+	}
+	mean /= window;
+	if (mean <= 0 || *max - *min > 0.2 * mean) {
+		return false;
+	}
+	// Least squares over x = 0 .. window - 1
+	double x_mean = (window - 1) / 2.0;
+	double sxy = 0;
+	double sxx = 0;
+	for (size_t i = 0; i < window; ++i) {
+		sxy += (i - x_mean) * (first[i] - mean);
+		sxx += (i - x_mean) * (i - x_mean);
+	}
+	double slope = sxy / sxx;
+	return std::abs(slope) * (window - 1) <= 0.1 * mean;
+}
+
+void write_precondition_state(
+	const std::string &path, const PreconditionState &state
+) {
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == nullptr) {
+		perror("fopen");
+		rusty_panic("Failed to open %s", path.c_str());
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "  \"version\": %d,\n", STATE_VERSION);
+	fprintf(file, "  \"dev\": %" PRIu64 ",\n", state.dev);
+	fprintf(file, "  \"ino\": %" PRIu64 ",\n", state.ino);
+	fprintf(file, "  \"size\": %" PRIu64 ",\n", state.size);
+	fprintf(file, "  \"bs\": %" PRIu64 ",\n", state.bs);
+	fprintf(file, "  \"iodepth\": %" PRIu64 ",\n", state.iodepth);
+	fprintf(file, "  \"numjobs\": %" PRIu64 ",\n", state.numjobs);
+	fprintf(file, "  \"rounds\": %" PRIu64 ",\n", state.rounds);
+	fprintf(
+		file, "  \"steady_state\": %s,\n",
+		state.steady_state ? "true" : "false"
+	);
+	fprintf(file, "  \"iops\": %.3f,\n", state.iops);
+	fprintf(file, "  \"time\": %" PRId64 "\n", state.time);
+	fprintf(file, "}\n");
+	if (fclose(file) != 0) {
+		perror("fclose");
+		rusty_panic("Failed to write %s", path.c_str());
+	}
+}
+
+PreconditionState read_precondition_state(const std::string &path) {
+	namespace pt = boost::property_tree;
+	try {
+		pt::ptree tree;
+		pt::read_json(path, tree);
+		int version = tree.get<int>("version");
+		rusty_assert(
+			version == STATE_VERSION, "%s: unsupported version %d",
+			path.c_str(), version
+		);
+		return PreconditionState{
+			.dev = tree.get<uint64_t>("dev"),
+			.ino = tree.get<uint64_t>("ino"),
+			.size = tree.get<uint64_t>("size"),
+			.bs = tree.get<uint64_t>("bs"),
+			.iodepth = tree.get<uint64_t>("iodepth"),
+			.numjobs = tree.get<uint64_t>("numjobs"),
+			.rounds = tree.get<uint64_t>("rounds"),
+			.steady_state = tree.get<bool>("steady_state"),
+			.iops = tree.get<double>("iops"),
+			.time = tree.get<int64_t>("time"),
+		};
+	} catch (const pt::ptree_error &e) {
+		rusty_panic("Invalid state file %s: %s", path.c_str(), e.what());
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef PRECONDITION_H_
+#define PRECONDITION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Number of the last rounds of random writes that have to agree for a
+// steady state
+constexpr size_t STEADY_STATE_WINDOW = 5;
+
+// As in the SNIA Solid State Storage Performance Test Specification: the
+// last window values span at most 20% of their mean, and their
+// least-squares line changes by at most 10% of it over the window.
+bool is_steady_state(const std::vector<double> &values, size_t window);
+
+// What the precondition mode did to a file, recorded next to it so that
+// later runs can check that the file is still in that state
+struct PreconditionState {
+	// Identify the file
+	uint64_t dev;
+	uint64_t ino;
+	// Bytes written from the start of the file
+	uint64_t size;
+	uint64_t bs;
+	uint64_t iodepth;
+	uint64_t numjobs;
+	// Rounds of random writes done
+	uint64_t rounds;
+	bool steady_state;
+	// Mean write IOPS of the last STEADY_STATE_WINDOW rounds
+	double iops;
+	// Unix time of the end
+	int64_t time;
+};
+
+void write_precondition_state(
+	const std::string &path, const PreconditionState &state
+);
+// Panics if the file is not a state file of this tool
+PreconditionState read_precondition_state(const std::string &path);
+
+#endif // PRECONDITION_H_
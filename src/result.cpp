@@ -0,0 +1,163 @@
+#include "result.h"
+
+#include <algorithm>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <cinttypes>
+#include <cstdio>
+#include <rusty/macro.h>
+
+// Version of the format of result files
+constexpr int RESULT_VERSION = 1;
+
+static std::string json_string(const std::string &s) {
+	std::string out = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if ((unsigned char)c < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			out += escaped;
+		} else {
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+static FILE *open_result(const std::string &path) {
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == nullptr) {
+		perror("fopen");
+		rusty_panic("Failed to open %s", path.c_str());
+	}
+	return file;
+}
+
+static void close_result(FILE *file, const std::string &path) {
+	if (fclose(file) != 0) {
+		perror("fclose");
+		rusty_panic("Failed to write %s", path.c_str());
+	}
+}
+
+// Writes the fields of result after the command, each on a line of its
+// own starting with indent
+static void write_fields(
+	FILE *file, const RunResult &result, const char *indent
+) {
+	const Histogram &h = result.latency;
+	fprintf(file, "%s\"ops\": %" PRIu64 ",\n", indent, result.ops);
+	fprintf(file, "%s\"bytes\": %" PRIu64 ",\n", indent, result.bytes);
+	fprintf(file, "%s\"run_time_s\": %.9f,\n", indent, result.run_time_s);
+	fprintf(file, "%s\"cpu_s\": %.6f,\n", indent, result.cpu_s);
+	fprintf(
+		file, "%s\"throughput_mbps\": %.3f,\n", indent,
+		result.run_time_s > 0 ? result.bytes / result.run_time_s / 1e6 : 0
+	);
+	fprintf(
+		file, "%s\"latency_sum_ns\": %" PRIu64 ",\n", indent,
+		result.latency_sum_ns
+	);
+	fprintf(
+		file,
+		"%s\"latency_ns\": {\"p50\": %" PRIu64 ", \"p90\": %" PRIu64
+			", \"p99\": %" PRIu64 ", \"p99.9\": %" PRIu64 ", \"max\": %"
+			PRIu64 "},\n",
+		indent, h.percentile(0.5), h.percentile(0.9), h.percentile(0.99),
+		h.percentile(0.999), h.max()
+	);
+	fprintf(file, "%s\"latency_histogram\": [", indent);
+	bool first = true;
+	for (size_t i = 0; i < Histogram::NUM_BUCKETS; ++i) {
+		uint64_t n = h.bucket_count(i);
+		if (n) {
+			fprintf(
+				file, "%s[%" PRIu64 ", %" PRIu64 "]", first ? "" : ", ",
+				Histogram::bucket_lower(i), n
+			);
+			first = false;
+		}
+	}
+	fprintf(file, "]\n");
+}
+
+void write_result(const std::string &path, const RunResult &result) {
+	FILE *file = open_result(path);
+	fprintf(file, "{\n");
+	fprintf(file, "  \"version\": %d,\n", RESULT_VERSION);
+	fprintf(file, "  \"command\": %s,\n", json_string(result.command).c_str());
+	write_fields(file, result, "  ");
+	fprintf(file, "}\n");
+	close_result(file, path);
+}
+
+void write_sweep_result(
+	const std::string &path, const std::string &command,
+	const std::vector<SweepPoint> &points
+) {
+	FILE *file = open_result(path);
+	fprintf(file, "{\n");
+	fprintf(file, "  \"version\": %d,\n", RESULT_VERSION);
+	fprintf(file, "  \"command\": %s,\n", json_string(command).c_str());
+	fprintf(file, "  \"points\": [");
+	for (size_t i = 0; i < points.size(); ++i) {
+		const SweepPoint &p = points[i];
+		fprintf(file, "%s\n    {\n", i ? "," : "");
+		fprintf(
+			file, "      \"readwrite\": %s,\n", json_string(p.readwrite).c_str()
+		);
+		fprintf(file, "      \"bs\": %" PRIu64 ",\n", p.bs);
+		if (p.bandwidth.has_value()) {
+			fprintf(
+				file, "      \"bandwidth\": %" PRIu64 ",\n", p.bandwidth.value()
+			);
+		} else {
+			fprintf(file, "      \"bandwidth\": null,\n");
+		}
+		fprintf(file, "      \"numjobs\": %" PRIu64 ",\n", p.numjobs);
+		fprintf(file, "      \"iodepth\": %" PRIu64 ",\n", p.iodepth);
+		write_fields(file, p.result, "      ");
+		fprintf(file, "    }");
+	}
+	fprintf(file, "\n  ]\n}\n");
+	close_result(file, path);
+}
+
+RunResult read_result(const std::string &path) {
+	namespace pt = boost::property_tree;
+	try {
+		pt::ptree tree;
+		pt::read_json(path, tree);
+		int version = tree.get<int>("version");
+		rusty_assert(
+			version == RESULT_VERSION, "%s: unsupported version %d",
+			path.c_str(), version
+		);
+		RunResult result{
+			.command = tree.get<std::string>("command"),
+			.ops = tree.get<uint64_t>("ops"),
+			.bytes = tree.get<uint64_t>("bytes"),
+			.run_time_s = tree.get<double>("run_time_s"),
+			.cpu_s = tree.get<double>("cpu_s"),
+			.latency_sum_ns = tree.get<uint64_t>("latency_sum_ns"),
+			.latency = Histogram(),
+		};
+		uint64_t max = tree.get<uint64_t>("latency_ns.max");
+		for (const auto &[key, pair] : tree.get_child("latency_histogram")) {
+			rusty_assert(pair.size() == 2, "%s: invalid bucket", path.c_str());
+			uint64_t lower = pair.front().second.get_value<uint64_t>();
+			uint64_t n = pair.back().second.get_value<uint64_t>();
+			// The last bucket holds the maximum
+			size_t bucket = Histogram::bucket_of(lower);
+			result.latency.record(
+				std::min(Histogram::bucket_upper(bucket), max), n
+			);
+		}
+		return result;
+	} catch (const pt::ptree_error &e) {
+		rusty_panic("Invalid result file %s: %s", path.c_str(), e.what());
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef RESULT_H_
+#define RESULT_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+
+// Summary of a run as a whole, written with --json_output and read back
+// by the compare subcommand
+struct RunResult {
+	// Command line of the run
+	std::string command;
+	uint64_t ops;
+	uint64_t bytes;
+	double run_time_s;
+	// User and system CPU time of the process during the run
+	double cpu_s;
+	uint64_t latency_sum_ns;
+	Histogram latency;
+};
+
+// The file is a JSON object with the fields of RunResult, the percentiles
+// of the latency for people reading it, and the non-empty buckets of the
+// latency histogram as [lower_ns, count] pairs.
+void write_result(const std::string &path, const RunResult &result);
+// Panics if the file is not a result file of this tool
+RunResult read_result(const std::string &path);
+
+// A point of --sweep and its result
+struct SweepPoint {
+	std::string readwrite;
+	uint64_t bs;
+	// Bytes per second per job. Unpaced if empty.
+	std::optional<uint64_t> bandwidth;
+	uint64_t numjobs;
+	uint64_t iodepth;
+	RunResult result;
+};
+
+// The file is a JSON object with the command line and an array "points"
+// holding the parameters of each point along with the fields of its
+// result as in write_result.
+void write_sweep_result(
+	const std::string &path, const std::string &command,
+	const std::vector<SweepPoint> &points
+);
+
+#endif // RESULT_H_
@@ -0,0 +1,288 @@
+#include "small_files.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <rusty/macro.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Open, read or write, and close
+constexpr size_t IOS_PER_FILE = 3;
+
+SmallFileWorker::SmallFileWorker(
+	const SmallFileOptions &options, size_t id, uint64_t seed
+) : options_(options),
+	id_(id),
+	rng_(seed),
+	tree_(options_.dir, id, options_.nrfiles, options_.files_per_dir),
+	buf_(options_.iodepth * options_.file_size.max),
+	executor_(
+		new_engine(rng_()), options_.iodepth, 1,
+		options_.iodepth * IOS_PER_FILE
+	),
+	bytes_(0),
+	run_time_(rusty::time::Duration::from_nanos(0)),
+	num_errors_(0) {
+	for (size_t i = 0; i < options_.nrfiles; ++i) {
+		names_.push_back(FileTree::file_name(i));
+	}
+	if (!options_.write) {
+		for (size_t i = 0; i < options_.nrfiles; ++i) {
+			int fd = openat(
+				tree_.dir_fd(i), names_[i].c_str(), O_CREAT | O_RDWR,
+				S_IRUSR | S_IWUSR
+			);
+			if (fd == -1) {
+				perror("openat");
+				rusty_panic();
+			}
+			struct stat st;
+			if (fstat(fd, &st) == -1) {
+				perror("fstat");
+				rusty_panic();
+			}
+			size_t size = st.st_size;
+			if (size == 0 || size > options_.file_size.max) {
+				size = random_size();
+				if (ftruncate(fd, 0) == -1) {
+					perror("ftruncate");
+					rusty_panic();
+				}
+				ssize_t ret = ::pwrite(fd, buf_.data(), size, 0);
+				if (ret != (ssize_t)size) {
+					perror("pwrite");
+					rusty_panic();
+				}
+			}
+			close(fd);
+			sizes_.push_back(size);
+		}
+	}
+	if (options_.link) {
+		// A chain opens its file into the file slot of its I/O slot
+		executor_.register_file_slots(options_.iodepth);
+	}
+}
+
+SmallFileWorker::SmallFileWorker(SmallFileWorker &&other)
+  : options_(other.options_),
+	id_(other.id_),
+	rng_(other.rng_),
+	tree_(std::move(other.tree_)),
+	names_(std::move(other.names_)),
+	sizes_(std::move(other.sizes_)),
+	buf_(std::move(other.buf_)),
+	executor_(std::move(other.executor_)),
+	latency_(other.latency_),
+	pacing_(other.pacing_),
+	bytes_(other.bytes_),
+	run_time_(other.run_time_),
+	errors_(std::move(other.errors_)),
+	num_errors_(other.num_errors_) {}
+
+void SmallFileWorker::run(rusty::time::Instant start) {
+	executor_.spawn(issue());
+	executor_.run(start);
+	run_time_ += start.elapsed();
+}
+
+Task SmallFileWorker::issue() {
+	uint64_t next_ns = 0;
+	for (size_t i = 0; i < options_.num_ops; ++i) {
+		co_await executor_.sleep_until(next_ns);
+		size_t slot = co_await executor_.acquire_slot();
+		size_t file = std::uniform_int_distribution<size_t>(
+			0, options_.nrfiles - 1
+		)(rng_);
+		size_t size = options_.write ? random_size() : sizes_[file];
+		if (options_.bandwidth.has_value()) {
+			uint64_t interval_ns = size * 1e9 / options_.bandwidth.value();
+			// Waiting for a free slot also delays the file
+			uint64_t now = executor_.now_ns();
+			pacing_.record(now > next_ns ? now - next_ns : 0, interval_ns);
+			next_ns += interval_ns;
+		}
+		executor_.spawn(do_file(slot, file, size));
+	}
+}
+
+void SmallFileWorker::fail_file(IOOp op, const char *op_name, int err) {
+	if (!tolerates_error(options_.continue_on_error, op)) {
+		errno = err;
+		perror(op_name);
+		rusty_panic();
+	}
+	errors_[err] += 1;
+	num_errors_ += 1;
+	if (
+		options_.max_errors.has_value() &&
+		num_errors_ > options_.max_errors.value()
+	) {
+		rusty_panic(
+			"Job %zu: more than %zu file errors, the last one %s: %s", id_,
+			options_.max_errors.value(), op_name, error_name(err).c_str()
+		);
+	}
+}
+
+Task SmallFileWorker::do_file(size_t slot, size_t file, size_t size) {
+	uint64_t issue_ns = executor_.now_ns();
+	char *buf = buf_.data() + slot * options_.file_size.max;
+	IOOp op = options_.write ? IOOp::Write : IOOp::Read;
+	const char *op_name = options_.write ? "write" : "read";
+	int flags = options_.write ? O_CREAT | O_TRUNC | O_WRONLY : O_RDONLY;
+	size_t retries = 0;
+	uint64_t backoff_ns = options_.retry_backoff_ns;
+	for (;;) {
+		// The first call of the file that failed, and its error
+		const char *failed = nullptr;
+		int err = 0;
+		uint64_t done_ns = issue_ns;
+		if (options_.link) {
+			IOUnit chain[IOS_PER_FILE] = {
+				IOUnit{
+					.op = IOOp::Open,
+					.fd = tree_.dir_fd(file),
+					.buf = nullptr,
+					.len = 0,
+					.offset = 0,
+					.user_data = 0,
+					.path = names_[file].c_str(),
+					.flags = flags,
+					.file_slot = (int)slot,
+				},
+				IOUnit{
+					.op = op,
+					.fd = -1,
+					.buf = buf,
+					.len = size,
+					.offset = 0,
+					.user_data = 0,
+					.file_slot = (int)slot,
+				},
+				IOUnit{
+					.op = IOOp::Close,
+					.fd = -1,
+					.buf = nullptr,
+					.len = 0,
+					.offset = 0,
+					.user_data = 0,
+					.file_slot = (int)slot,
+				},
+			};
+			std::vector<IOResult> results =
+				co_await executor_.io_chain(chain, IOS_PER_FILE);
+			// Only the first failure of the chain is of interest. The I/Os
+			// after it were cancelled.
+			const char *names[IOS_PER_FILE] = {"openat", op_name, "close"};
+			for (size_t i = 0; i < IOS_PER_FILE; ++i) {
+				if (results[i].res < 0) {
+					failed = names[i];
+					err = -results[i].res;
+					break;
+				}
+				rusty_assert(
+					i != 1 || results[i].res == (ssize_t)size,
+					"Short %s of %s", op_name, names_[file].c_str()
+				);
+			}
+			done_ns = results[2].time_ns;
+		} else {
+			IOResult result = co_await executor_.io(IOUnit{
+				.op = IOOp::Open,
+				.fd = tree_.dir_fd(file),
+				.buf = nullptr,
+				.len = 0,
+				.offset = 0,
+				.user_data = 0,
+				.path = names_[file].c_str(),
+				.flags = flags,
+			});
+			if (result.res < 0) {
+				failed = "openat";
+				err = -result.res;
+			} else {
+				int fd = result.res;
+				result = co_await executor_.io(IOUnit{
+					.op = op,
+					.fd = fd,
+					.buf = buf,
+					.len = size,
+					.offset = 0,
+					.user_data = 0,
+				});
+				if (result.res < 0) {
+					failed = op_name;
+					err = -result.res;
+				} else {
+					rusty_assert(
+						result.res == (ssize_t)size, "Short %s of %s",
+						op_name, names_[file].c_str()
+					);
+				}
+				// The file is closed even if the read or write failed
+				result = co_await executor_.io(IOUnit{
+					.op = IOOp::Close,
+					.fd = fd,
+					.buf = nullptr,
+					.len = 0,
+					.offset = 0,
+					.user_data = 0,
+				});
+				if (result.res < 0 && failed == nullptr) {
+					failed = "close";
+					err = -result.res;
+				}
+				done_ns = result.time_ns;
+			}
+		}
+		if (failed == nullptr) {
+			latency_.record(done_ns - issue_ns);
+			bytes_ += size;
+			break;
+		}
+		if (retries < options_.io_retries) {
+			// The file is done again from its open
+			retries += 1;
+			co_await executor_.sleep_until(executor_.now_ns() + backoff_ns);
+			backoff_ns *= 2;
+			continue;
+		}
+		fail_file(op, failed, err);
+		break;
+	}
+	executor_.release_slot(slot);
+}
+
+size_t SmallFileWorker::random_size() {
+	const FileSizeDistribution &d = options_.file_size;
+	double size = 0;
+	switch (d.type) {
+	case FileSizeDistributionType::Fixed:
+		size = d.a;
+		break;
+	case FileSizeDistributionType::Uniform:
+		size = std::uniform_real_distribution<double>(d.a, d.b)(rng_);
+		break;
+	case FileSizeDistributionType::LogNormal:
+		size = std::lognormal_distribution<double>(std::log(d.a), d.b)(rng_);
+		break;
+	}
+	// Empty files would be recreated on every run
+	return std::max<size_t>(std::min<double>(size, d.max), 1);
+}
+
+std::unique_ptr<IOEngine> SmallFileWorker::new_engine(uint64_t seed) {
+	size_t depth = options_.iodepth * IOS_PER_FILE;
+	auto engine = new_io_engine(options_.io_engine, depth);
+	if (!options_.faults.has_value()) {
+		return engine;
+	}
+	return new_faulty_engine(
+		std::move(engine), depth, options_.faults.value(), seed
+	);
+}
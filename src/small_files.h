@@ -0,0 +1,114 @@
+#ifndef SMALL_FILES_H_
+#define SMALL_FILES_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <random>
+#include <rusty/time.h>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "faulty_engine.h"
+#include "file_tree.h"
+#include "histogram.h"
+#include "io_engine.h"
+#include "io_error.h"
+#include "pacing.h"
+
+enum class FileSizeDistributionType {
+	// a
+	Fixed,
+	// Uniform in [a, b]
+	Uniform,
+	// Log-normal with median a and shape sigma b, capped at max
+	LogNormal,
+};
+
+// File sizes in bytes
+struct FileSizeDistribution {
+	FileSizeDistributionType type;
+	double a;
+	double b;
+	// No file is larger
+	size_t max;
+};
+
+struct SmallFileOptions {
+	std::string dir;
+	// Reads whole files if false
+	bool write;
+	// Number of files per job
+	size_t nrfiles;
+	size_t files_per_dir;
+	// Number of files read or written per job
+	size_t num_ops;
+	FileSizeDistribution file_size;
+	// Bytes per second per job
+	std::optional<size_t> bandwidth;
+	// Submit open, read or write, and close as one linked chain
+	bool link;
+	IOEngineType io_engine;
+	std::optional<FaultConfig> faults;
+	// Number of files in flight per job
+	size_t iodepth;
+	// As for the block workloads. A file whose open, read or write, or
+	// close fails is retried and counted as a whole, as a read in read
+	// mode and as a write in write mode.
+	ContinueOnError continue_on_error;
+	size_t io_retries;
+	uint64_t retry_backoff_ns;
+	std::optional<size_t> max_errors;
+};
+
+// Reads or writes whole files of a tree of its own,
+// <dir>/job<id>/d<k>/f<i>, picked at random. Each file is opened, read or
+// written in one I/O, and closed. The files start at the pacing ticks of
+// the bandwidth, each tick as far after the previous one as its size
+// takes at the bandwidth.
+class SmallFileWorker {
+public:
+	// Creates the tree. In read mode files left over by an earlier run are
+	// kept if they are not larger than the distribution allows.
+	SmallFileWorker(const SmallFileOptions &options, size_t id, uint64_t seed);
+	SmallFileWorker(SmallFileWorker &&other);
+	SmallFileWorker(const SmallFileWorker &) = delete;
+	// Starts at start, which may be in the future
+	void run(rusty::time::Instant start);
+	// Latency from open to the completion of close
+	const Histogram &latency() const { return latency_; }
+	// Empty if not paced
+	const PacingStats &pacing() const { return pacing_; }
+	size_t bytes() const { return bytes_; }
+	// Number of failed files by errno
+	const std::map<int, size_t> &errors() const { return errors_; }
+	rusty::time::Duration run_time() const { return run_time_; }
+
+private:
+	Task issue();
+	Task do_file(size_t slot, size_t file, size_t size);
+	// Counts the error if failed files may be skipped, aborts otherwise
+	void fail_file(IOOp op, const char *op_name, int err);
+	size_t random_size();
+	std::unique_ptr<IOEngine> new_engine(uint64_t seed);
+
+	const SmallFileOptions &options_;
+	size_t id_;
+	std::mt19937_64 rng_;
+	FileTree tree_;
+	std::vector<std::string> names_;
+	// Size of each file in read mode
+	std::vector<size_t> sizes_;
+	std::vector<char> buf_;
+	Executor executor_;
+	Histogram latency_;
+	PacingStats pacing_;
+	size_t bytes_;
+	rusty::time::Duration run_time_;
+	std::map<int, size_t> errors_;
+	size_t num_errors_;
+};
+
+#endif // SMALL_FILES_H_